@@ -2,6 +2,8 @@
 #include <ArduinoLog.h>
 
 bool useOTAA = true;
+// Mains-powered devices can keep listening for downlinks instead of polling
+bool useClassC = false;
 
 // Change if using OTAA
 const char* otaaDevEui = "CHANGE_ME";
@@ -30,6 +32,10 @@ void setup() {
  
   dev = SimpleTTN::initialize();
 
+  SimpleTTNConfiguration configuration;
+  configuration.classC = useClassC;
+  dev->configure(configuration);
+
   if (useOTAA) {
     dev->provisionOTAA(otaaDevEui, otaaAppEui, otaaAppKey);
   } else {
@@ -47,7 +53,7 @@ void setup() {
 u1_t val = 1;
 void loop() {
   if (dev->state() == SimpleTTNStateReady) {
-    if (val % 2 == 1) {
+    if (useClassC || val % 2 == 1) {
       Serial.println("Sending");
       dev->send({val, val, val}, 2);
     } else {
@@ -0,0 +1,23 @@
+// The Things Network payload formatter for uplinks sent with SimpleTTN::sendRecord().
+// A frame holds one or more records, each prefixed with its length in bytes:
+//
+//   | len0 | record0 ... | len1 | record1 ... | ...
+//
+function decodeUplink(input) {
+  var bytes = input.bytes;
+  var records = [];
+  var i = 0;
+  while (i < bytes.length) {
+    var length = bytes[i];
+    i += 1;
+    if (length === 0 || i + length > bytes.length) {
+      return {
+        data: { records: records },
+        errors: ["invalid record length " + length + " at byte " + (i - 1)]
+      };
+    }
+    records.push(bytes.slice(i, i + length));
+    i += length;
+  }
+  return { data: { records: records } };
+}
@@ -0,0 +1,77 @@
+// Helpers for decoding sample arrays built with the LMIC_encode*() functions
+// in lmic_util.h. Copy the ones you need into your payload formatter, e.g.:
+//
+//   function decodeUplink(input) {
+//     return { data: { temperature: decodeDeltaVarint(input.bytes, 100) } };
+//   }
+//
+
+function decodeFloat(v, nFraction, signBit) {
+  var fraction = v & ((1 << nFraction) - 1);
+  var exponent = (v >> nFraction) & 0xf;
+  var f = fraction * Math.pow(2, exponent - 15 - nFraction);
+  return signBit && (v & signBit) ? -f : f;
+}
+
+function decode16(bytes, decode) {
+  var out = [];
+  for (var i = 0; i + 1 < bytes.length; i += 2) {
+    out.push(decode((bytes[i] << 8) | bytes[i + 1]));
+  }
+  return out;
+}
+
+function decode12(bytes, decode) {
+  var out = [];
+  var n = Math.floor((bytes.length * 8) / 12);
+  for (var i = 0; i < n; i++) {
+    var j = (i >> 1) * 3;
+    var v = (i & 1) === 0
+      ? (bytes[j] << 4) | (bytes[j + 1] >> 4)
+      : ((bytes[j + 1] & 0xf) << 8) | bytes[j + 2];
+    out.push(decode(v));
+  }
+  return out;
+}
+
+function decodeSflt16(bytes) {
+  return decode16(bytes, function (v) { return decodeFloat(v, 11, 0x8000); });
+}
+
+function decodeUflt16(bytes) {
+  return decode16(bytes, function (v) { return decodeFloat(v, 12, 0); });
+}
+
+function decodeSflt12(bytes) {
+  return decode12(bytes, function (v) { return decodeFloat(v, 7, 0x800); });
+}
+
+function decodeUflt12(bytes) {
+  return decode12(bytes, function (v) { return decodeFloat(v, 8, 0); });
+}
+
+function decodeFixed16(bytes, scale) {
+  return decode16(bytes, function (v) { return ((v << 16) >> 16) / scale; });
+}
+
+function decodeDeltaVarint(bytes, scale) {
+  var out = [];
+  var previous = 0;
+  var i = 0;
+  while (i < bytes.length) {
+    var zigzag = 0;
+    var shift = 0;
+    var b;
+    do {
+      if (i === bytes.length) {
+        return out;
+      }
+      b = bytes[i++];
+      zigzag += (b & 0x7f) * Math.pow(2, shift);
+      shift += 7;
+    } while (b & 0x80);
+    previous += zigzag % 2 ? -(zigzag + 1) / 2 : zigzag / 2;
+    out.push(previous / scale);
+  }
+  return out;
+}
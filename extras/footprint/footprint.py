@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""Measures the RAM and flash used by SimpleTTN and LMIC for each compile option.
+
+Builds examples/basic with arduino-cli once per configuration of FEATURES and
+writes a JSON report with, for each one:
+
+  - lmic_t: sizeof(lmic_t), from the size of the LMIC symbol
+  - ram: static RAM of the sketch (.dram0.data + .dram0.bss)
+  - flash: flash of the sketch (code, read-only data and initialized data)
+  - saved: what the configuration saves compared to "default", negative for
+    the options that add features
+  - objects: text/data/bss of each object file of the library
+
+The stack left unused by the TTN task can only be measured on a device:
+SimpleTTN::statusDescription() prints it, and --stack-log picks it up from a
+captured serial log.
+
+Usage:
+
+  extras/footprint/footprint.py --output footprint.json
+  extras/footprint/footprint.py --baseline footprint.json --tolerance 32
+
+With --baseline, the exit status is 1 if any configuration grew by more than
+--tolerance bytes in lmic_t, ram or flash, or no longer builds, so it can gate
+regressions.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+REPO = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..'))
+SKETCH = os.path.join(REPO, 'examples', 'basic')
+
+MCMD = [
+    'DISABLE_MCMD_DutyCycleReq',
+    'DISABLE_MCMD_RXParamSetupReq',
+    'DISABLE_MCMD_NewChannelReq',
+    'DISABLE_MCMD_DlChannelReq',
+    'DISABLE_MCMD_RXTimingSetupReq',
+    'DISABLE_MCMD_PingSlotChannelReq',
+]
+
+# Configuration name and the defines it adds to the default build
+FEATURES = [
+    ('default', []),
+    ('no-ping', ['DISABLE_PING']),
+    ('no-beacons', ['DISABLE_PING', 'DISABLE_BEACONS']),
+    ('no-join', ['DISABLE_JOIN']),
+    ('short-messages', ['LMIC_ENABLE_long_messages=0']),
+    ('no-mcmd', MCMD),
+    ('channel-stats', ['LMIC_ENABLE_channel_stats=1']),
+    ('no-class-c', ['LMIC_ENABLE_class_c=0']),
+    ('multicast', ['LMIC_MULTICAST_GROUPS=4']),
+    ('no-lbt-cad', ['LMIC_ENABLE_lbt_cad=0']),
+    ('minimal', ['DISABLE_PING', 'DISABLE_BEACONS', 'LMIC_ENABLE_long_messages=0',
+                 'LMIC_ENABLE_class_c=0', 'LMIC_ENABLE_lbt_cad=0'] + MCMD),
+]
+
+RAM_SECTIONS = ['.dram0.data', '.dram0.bss']
+FLASH_SECTIONS = ['.flash.text', '.flash.rodata', '.iram0.vectors', '.iram0.text', '.dram0.data']
+
+
+def run(command):
+    return subprocess.run(command, check=True, capture_output=True, text=True).stdout
+
+
+def first_error(output):
+    # arduino-cli ends with a generic "exit status 1", the compiler's message comes first
+    lines = output.strip().splitlines()
+    errors = [line for line in lines if 'error:' in line]
+    return (errors or lines)[:1]
+
+
+def build(args, defines, build_path):
+    flags = ' '.join('-D' + define for define in defines)
+    run([args.arduino_cli, 'compile', '--fqbn', args.fqbn,
+         '--library', REPO, '--build-path', build_path,
+         '--build-property', 'compiler.c.extra_flags=' + flags,
+         '--build-property', 'compiler.cpp.extra_flags=' + flags,
+         SKETCH])
+    return os.path.join(build_path, os.path.basename(SKETCH) + '.ino.elf')
+
+
+def section_sizes(args, elf):
+    sizes = {}
+    for line in run([args.size_tool, '-A', elf]).splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0].startswith('.') and fields[1].isdigit():
+            sizes[fields[0]] = int(fields[1])
+    return sizes
+
+
+def symbol_size(args, elf, name):
+    for line in run([args.nm_tool, '-S', elf]).splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[3] == name:
+            return int(fields[1], 16)
+    return None
+
+
+def object_sizes(args, build_path):
+    library = os.path.join(build_path, 'libraries', 'SimpleTTN')
+    objects = {}
+    for root, _, files in os.walk(library):
+        for name in sorted(files):
+            if not name.endswith('.o'):
+                continue
+            path = os.path.join(root, name)
+            lines = run([args.size_tool, '--format=berkeley', path]).splitlines()
+            text, data, bss = (int(value) for value in lines[1].split()[:3])
+            objects[os.path.relpath(path, library)] = {'text': text, 'data': data, 'bss': bss}
+    return objects
+
+
+def measure(args, name, defines, work):
+    result = {'name': name, 'defines': defines}
+    build_path = os.path.join(work, name)
+    try:
+        elf = build(args, defines, build_path)
+    except subprocess.CalledProcessError as error:
+        # Some options aren't supported by SimpleTTN, report them as such
+        result['error'] = first_error((error.stderr or '') + '\n' + (error.stdout or ''))
+        return result
+    sections = section_sizes(args, elf)
+    result['lmic_t'] = symbol_size(args, elf, 'LMIC')
+    result['ram'] = sum(sections.get(section, 0) for section in RAM_SECTIONS)
+    result['flash'] = sum(sections.get(section, 0) for section in FLASH_SECTIONS)
+    result['objects'] = object_sizes(args, build_path)
+    return result
+
+
+def stack_unused(log):
+    unused = None
+    with open(log) as stream:
+        for line in stream:
+            match = re.search(r'Task stack unused: (\d+)', line)
+            if match:
+                unused = int(match.group(1)) if unused is None else min(unused, int(match.group(1)))
+    return unused
+
+
+def regressions(report, baseline, tolerance):
+    before = {config['name']: config for config in baseline['configs']}
+    found = []
+    for config in report['configs']:
+        old = before.get(config['name'])
+        if old is None or 'error' in old:
+            continue
+        if 'error' in config:
+            found.append('%s: no longer builds: %s' % (config['name'], ' '.join(config['error'])))
+            continue
+        for key in ('lmic_t', 'ram', 'flash'):
+            if config[key] is not None and old[key] is not None and config[key] - old[key] > tolerance:
+                found.append('%s: %s grew from %d to %d bytes' % (config['name'], key, old[key], config[key]))
+    return found
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--fqbn', default='esp32:esp32:heltec_wifi_lora_32')
+    parser.add_argument('--arduino-cli', default='arduino-cli')
+    parser.add_argument('--size-tool', default='xtensa-esp32-elf-size')
+    parser.add_argument('--nm-tool', default='xtensa-esp32-elf-nm')
+    parser.add_argument('--only', action='append', help='measure only this configuration')
+    parser.add_argument('--stack-log', help='serial log with statusDescription() output')
+    parser.add_argument('--output', help='report file, stdout by default')
+    parser.add_argument('--baseline', help='previous report to compare with')
+    parser.add_argument('--tolerance', type=int, default=0, help='bytes of growth allowed')
+    args = parser.parse_args()
+
+    # Read before measuring, the report may replace it
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as stream:
+            baseline = json.load(stream)
+
+    features = [feature for feature in FEATURES if not args.only or feature[0] in args.only]
+    with tempfile.TemporaryDirectory() as work:
+        configs = [measure(args, name, defines, work) for name, defines in features]
+
+    reference = next((config for config in configs if config['name'] == 'default' and 'error' not in config), None)
+    if reference is not None:
+        for config in configs:
+            if 'error' not in config and config['lmic_t'] is not None and reference['lmic_t'] is not None:
+                config['saved'] = {key: reference[key] - config[key] for key in ('lmic_t', 'ram', 'flash')}
+
+    report = {'fqbn': args.fqbn, 'configs': configs}
+    if args.stack_log:
+        report['task_stack_unused'] = stack_unused(args.stack_log)
+
+    text = json.dumps(report, indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, 'w') as stream:
+            stream.write(text + '\n')
+    else:
+        print(text)
+
+    if baseline is not None:
+        found = regressions(report, baseline, args.tolerance)
+        for message in found:
+            print(message, file=sys.stderr)
+        return 1 if found else 0
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
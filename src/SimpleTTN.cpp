@@ -1,11 +1,29 @@
 #include "SimpleTTN.h"
 
 #include "SimpleTTNDebug.h"
-#include "SimpleTTNUtil.h"
+#include "SimpleTTNRegionTraits.h"
 
 #include "lmic/lmic/oslmic.h"
 #include <ArduinoLog.h>
 
+#if !LMIC_ENABLE_user_events
+#error "SimpleTTN receives events and downlinks through LMIC_registerEventCb() and LMIC_registerRxMessageCb(), enable LMIC_ENABLE_user_events"
+#endif
+
+// Holds a recursive mutex until the end of the scope.
+class SimpleTTNLock {
+public:
+    explicit SimpleTTNLock(SemaphoreHandle_t mutex) : _mutex(mutex) {
+        xSemaphoreTakeRecursive(_mutex, portMAX_DELAY);
+    }
+    ~SimpleTTNLock() {
+        xSemaphoreGiveRecursive(_mutex);
+    }
+
+private:
+    SemaphoreHandle_t _mutex;
+};
+
 /// Static stuff
 
 static SimpleTTN *sInstance = nullptr;
@@ -39,16 +57,38 @@ SimpleTTN *SimpleTTN::initialize(const TTN_esp32_LMIC::HalPinmap_t* pinmap) {
 /// Instance functions
 
 SimpleTTN::SimpleTTN() {
+    _mutex = xSemaphoreCreateRecursiveMutex();
     _sequenceNumberUp = 0;
     _state = SimpleTTNStateIdle;
     configure(SimpleTTNConfiguration());
+    // Survive LMIC_reset()
+    LMIC_registerEventCb(eventCallback, this);
+    LMIC_registerRxMessageCb(rxMessage, this);
+    hal_setIrqNotify(radioInterrupt, this);
 }
 
 SimpleTTNState SimpleTTN::state() {
+    SimpleTTNLock lock(_mutex);
     return _state;
 }
 
-void SimpleTTN::configure(SimpleTTNConfiguration configuration) {
+bool SimpleTTN::configure(SimpleTTNConfiguration configuration) {
+    SimpleTTNLock lock(_mutex);
+    if (configuration.region != SimpleTTNRegionDefault && configuration.region != region()) {
+        Log.error("Region %s not supported, LMIC is built for %s",
+            describe(configuration.region).c_str(), describe(region()).c_str());
+        return false;
+    }
+#if CFG_LMIC_EU_like
+    if (configuration.joinDataRate >= 0 && !SimpleTTNConfiguredRegion::isLegal(configuration.joinDataRate)) {
+        Log.error("Join data rate %i isn't valid in %s", configuration.joinDataRate, describe(region()).c_str());
+        return false;
+    }
+#else
+    if (configuration.joinDataRate >= 0) {
+        Log.warning("The join data rate is fixed in %s", describe(region()).c_str());
+    }
+#endif
     _configuration = configuration;
 
     // TODO set LMIC properties and allow configuring them
@@ -59,36 +99,148 @@ void SimpleTTN::configure(SimpleTTNConfiguration configuration) {
     LMIC_setDrTxpow(DR_SF7, 14);
     // Allow 7% clock errors
     LMIC_setClockError(MAX_CLOCK_ERROR * 7 / 100);
+    // Bound the airtime spent on confirmed uplinks
+    LMIC_setConfirmedAttempts(_configuration.confirmedTransmissions);
+#if LMIC_ENABLE_channel_stats
+    LMIC_setAdaptiveChannels(_configuration.adaptiveChannels ? 1 : 0);
+#else
+    if (_configuration.adaptiveChannels) {
+        Log.warning("Channel statistics are disabled in the LMIC configuration");
+    }
+#endif
+#if LMIC_ENABLE_lbt_cad
+    LMIC_setLbtCad(_configuration.lbtChannelActivityDetection ? 1 : 0);
+#else
+    if (_configuration.lbtChannelActivityDetection) {
+        Log.warning("CAD listen before talk is disabled in the LMIC configuration");
+    }
+#endif
+#if LMIC_ENABLE_class_c
+    LMIC_setClassC(_configuration.classC ? 1 : 0);
+#else
+    if (_configuration.classC) {
+        Log.warning("Class C is disabled in the LMIC configuration");
+    }
+#endif
+#if !defined(DISABLE_PING)
+    if (_configuration.classB) {
+        if (LMIC.opmode & OP_PINGABLE) {
+            // Applies a new periodicity
+            LMIC_setPingable(_configuration.pingSlotPeriodicity);
+        }
+        _beaconSearchAt = millis();
+        _beaconSearchDelay = 0;
+    } else if (LMIC.opmode & (OP_PINGABLE | OP_TRACK | OP_SCAN)) {
+        LMIC_stopPingable();
+        LMIC_disableTracking();
+    }
+#else
+    if (_configuration.classB) {
+        Log.warning("Class B is disabled in the LMIC configuration");
+    }
+#endif
+    return true;
 }
 
-bool SimpleTTN::provisionOTAA(std::string devEui, std::string appEui, std::string appKey) {
-    // TODO check keys, return false if invalid
+SimpleTTNRegion SimpleTTN::region() {
+    return static_cast<SimpleTTNRegion>(CFG_region);
+}
 
-    _devEui = toBytes(devEui);
-    _appEui = toBytes(appEui);
-    _appKey = toBytes(appKey);
+bool SimpleTTN::provisionOTAA(const char *devEui, const char *appEui, const char *appKey) {
+    SimpleTTNLock lock(_mutex);
+    if (!SimpleTTNHex::isValid(devEui, _devEui.size()) || !SimpleTTNHex::isValid(appEui, _appEui.size()) ||
+        !SimpleTTNHex::isValid(appKey, _appKey.size())) {
+        Log.error("Invalid OTAA keys, expected hex EUIs of 8 bytes and an app key of 16 bytes");
+        return false;
+    }
 
+    SimpleTTNHex::parse(devEui, _devEui, true);
+    SimpleTTNHex::parse(appEui, _appEui, true);
+    SimpleTTNHex::parse(appKey, _appKey);
     return true;
 }
 
 bool SimpleTTN::join() {
+    SimpleTTNLock lock(_mutex);
     Log.trace("Joining");
-    
-    LMIC_unjoin();
-    LMIC_startJoining();
-    
-    this->startLoop();
-    
+
+    _joinStats = SimpleTTNJoinStats();
+    _joinStartedAt = millis();
+    // LMIC is reset and starts joining on the TTN task, see startJoining()
+    _joinRequested = true;
     _state = SimpleTTNStateJoining;
+
+    if (_taskHandle == nullptr) {
+        this->startLoop();
+    }
+    // After giving up, LMIC has no jobs left and the task may be sleeping
+    wake();
     return true;
 }
 
-bool SimpleTTN::provisionABP(std::string deviceAddress, std::string networkKey,
-                     std::string appSessionKey, u4_t sequenceNumberUp) {
-    // TODO check keys
-    _deviceAddress = toBytes(deviceAddress);
-    _networkKey = toBytes(networkKey);
-    _appSessionKey = toBytes(appSessionKey);
+// Called from service() after join().
+void SimpleTTN::startJoining() {
+    if (LMIC.opmode & OP_SHUTDOWN) {
+        // Stopped after the last failed round, keep the DevNonce sequence
+        uint16_t devNonce = LMIC.devNonce;
+        LMIC_reset();
+        LMIC.devNonce = devNonce;
+    }
+    LMIC_unjoin();
+    LMIC_startJoining();
+}
+
+SimpleTTNJoinStats SimpleTTN::joinStats() const {
+    SimpleTTNLock lock(_mutex);
+    return _joinStats;
+}
+
+void SimpleTTN::setDevNonce(uint16_t devNonce) {
+    SimpleTTNLock lock(_mutex);
+    LMIC.devNonce = devNonce;
+}
+
+uint16_t SimpleTTN::devNonce() const {
+    SimpleTTNLock lock(_mutex);
+    return LMIC.devNonce;
+}
+
+void SimpleTTN::onDevNonceUsed(void (*callback)(uint16_t nextDevNonce)) {
+    SimpleTTNLock lock(_mutex);
+    _devNonceCallback = callback;
+}
+
+// Starts the next round of join requests at the configured data rate. The
+// events come before LMIC schedules the next request, so this takes effect
+// right away.
+void SimpleTTN::restartJoinRound() {
+#if CFG_LMIC_EU_like
+    LMIC.datarate = _configuration.joinDataRate >= 0
+        ? _configuration.joinDataRate : (dr_t)LMICbandplan_getInitialDrJoin();
+#endif
+}
+
+uint32_t SimpleTTN::joinBackoff(uint32_t failedRounds) {
+    uint32_t backoff = _configuration.joinBackoff;
+    for (uint32_t i = 1; i < failedRounds && backoff < _configuration.joinBackoffMax; i++) {
+        backoff *= 2;
+    }
+    backoff = std::min(backoff, _configuration.joinBackoffMax);
+    return backoff + random(backoff / 2 + 1);
+}
+
+bool SimpleTTN::provisionABP(const char *deviceAddress, const char *networkKey,
+                             const char *appSessionKey, u4_t sequenceNumberUp) {
+    SimpleTTNLock lock(_mutex);
+    if (!SimpleTTNHex::isValid(deviceAddress, _deviceAddress.size()) ||
+        !SimpleTTNHex::isValid(networkKey, _networkKey.size()) ||
+        !SimpleTTNHex::isValid(appSessionKey, _appSessionKey.size())) {
+        Log.error("Invalid ABP keys, expected a hex address of 4 bytes and keys of 16 bytes");
+        return false;
+    }
+    SimpleTTNHex::parse(deviceAddress, _deviceAddress);
+    SimpleTTNHex::parse(networkKey, _networkKey);
+    SimpleTTNHex::parse(appSessionKey, _appSessionKey);
     _sequenceNumberUp = sequenceNumberUp;
 
     // 0x13 is the net ID for TTN
@@ -136,16 +288,23 @@ bool SimpleTTN::provisionABP(std::string deviceAddress, std::string networkKey,
 }
 
 void SimpleTTN::stop() {
+    SimpleTTNLock lock(_mutex);
     Log.trace("Stopping");
     if (_taskHandle != nullptr) {
         LMIC_reset();
         this->stopLoop();
         _taskHandle = nullptr;
     }
+    for (std::deque<QueuedMessage> &queue : _sendQueues) {
+        queue.clear();
+    }
+    _fragmentAnswer.clear();
+    _joinRequested = false;
     _state = SimpleTTNStateIdle;
 }
 
 bool SimpleTTN::poll(uint8_t port, bool confirm) {
+    SimpleTTNLock lock(_mutex);
     Log.trace("Polling on port %i", port);
     if (_state != SimpleTTNStateReady) {
         Log.error("Can't poll in state %s", describe(_state).c_str());
@@ -157,62 +316,373 @@ bool SimpleTTN::poll(uint8_t port, bool confirm) {
     }
 
     LMIC_setTxData2(port, nullptr, 1, confirm ? 1 : 0);
+    wake();
     return true;
 }
 
-bool SimpleTTN::send(const std::vector<uint8_t> &message, uint8_t port, bool confirm) {
-    Log.notice("Sending data on port %i: %s", port, describe(message).c_str());
+bool SimpleTTN::send(const std::vector<uint8_t> &message, uint8_t port, bool confirm,
+                     SimpleTTNPriority priority) {
+    SimpleTTNLock lock(_mutex);
+    Log.notice("Sending data on port %i (%s priority): %s", port,
+        describe(priority).c_str(), describe(message).c_str());
 
-    if (_state != SimpleTTNStateReady) {
+    if (_state != SimpleTTNStateReady && _state != SimpleTTNStateTransceiving) {
         Log.error("Can't send data in state %s", describe(_state).c_str());
         return false;
     }
+    if (message.size() > maxPayloadSize()) {
+        Log.error("Message of %i bytes doesn't fit a frame at the current data rate", message.size());
+        return false;
+    }
 
-    if (LMIC.opmode & OP_TXRXPEND) {
-        Log.error("LMIC indicates there's a pending transaction, cancelling send.");
+    QueuedMessage queued = {message, port, confirm, priority, (uint32_t)millis()};
+
+    if (_state == SimpleTTNStateTransceiving && priority > _pendingPriority && preemptSend()) {
+        startSend(queued);
+        wake();
+        return true;
+    }
+
+    // A poll holds LMIC's data until it goes on air
+    if (_state == SimpleTTNStateReady && !(LMIC.opmode & (OP_TXRXPEND | OP_TXDATA)) && queuedMessages() == 0) {
+        startSend(queued);
+        wake();
+        return true;
+    }
+
+    if (queuedMessages() >= _configuration.sendQueueSize) {
+        Log.error("Send queue is full, dropping message");
         return false;
     }
-    
-    _pendingMessage = message;
-    _state = SimpleTTNStateTransceiving;
+    _sendQueues[priority].push_back(queued);
+    wake();
+    return true;
+}
+
+size_t SimpleTTN::queuedMessages() const {
+    SimpleTTNLock lock(_mutex);
+    size_t count = 0;
+    for (const std::deque<QueuedMessage> &queue : _sendQueues) {
+        count += queue.size();
+    }
+    return count;
+}
+
+SimpleTTNQueueStats SimpleTTN::queueStats(SimpleTTNPriority priority) const {
+    SimpleTTNLock lock(_mutex);
+    return _queueStats[priority];
+}
+
+std::vector<SimpleTTNChannelStats> SimpleTTN::channelStats() const {
+    SimpleTTNLock lock(_mutex);
+    std::vector<SimpleTTNChannelStats> channels;
+#if LMIC_ENABLE_channel_stats
+    for (int channel = 0; channel < LMIC_CHANNEL_STATS_COUNT; ++channel) {
+        const lmic_channel_stats_t *stats = LMIC_getChannelStats(channel);
+        if (stats->uplinks == 0) {
+            continue;
+        }
+        SimpleTTNChannelStats result;
+        result.channel = channel;
+        result.frequency = LMIC_getChannelFreq(channel);
+        result.uplinks = stats->uplinks;
+        result.confirmed = stats->confirmed;
+        result.acknowledged = stats->acknowledged;
+        result.downlinks = stats->downlinks;
+        result.busy = stats->busy;
+        channels.push_back(result);
+    }
+#endif
+    return channels;
+}
+
+int32_t SimpleTTN::nextTxTime(uint8_t payloadLength) {
+    SimpleTTNLock lock(_mutex);
+    if (_state != SimpleTTNStateReady && _state != SimpleTTNStateTransceiving) {
+        return -1;
+    }
+    if (payloadLength > maxPayloadSize()) {
+        return -1;
+    }
+    ostime_t wait = LMIC_nextTxTime() - os_getTime();
+    return wait > 0 ? osticks2ms(wait) : 0;
+}
+
+void SimpleTTN::addProducer(uint32_t interval, uint8_t port,
+                            bool (*producer)(std::vector<uint8_t> &payload),
+                            SimpleTTNPriority priority) {
+    SimpleTTNLock lock(_mutex);
+    removeProducer(producer);
+    _producers.push_back({interval, port, priority, producer, (uint32_t)millis(), 0});
+    wake();
+}
+
+void SimpleTTN::removeProducer(bool (*producer)(std::vector<uint8_t> &payload)) {
+    SimpleTTNLock lock(_mutex);
+    _producers.erase(std::remove_if(_producers.begin(), _producers.end(),
+        [producer](const Producer &p) { return p.produce == producer; }), _producers.end());
+}
 
-    LMIC_setTxData2(port, _pendingMessage.data(), _pendingMessage.size(), confirm ? 1 : 0);
+bool SimpleTTN::sendRecord(const std::vector<uint8_t> &record, uint8_t port) {
+    SimpleTTNLock lock(_mutex);
+    Log.trace("Queueing record on port %i: %s", port, describe(record).c_str());
+
+    // one byte is used for the record length
+    if (record.size() == 0 || record.size() + 1 > maxPayloadSize()) {
+        Log.error("Can't queue record of %i bytes", record.size());
+        return false;
+    }
+
+    RecordBatch *batch = recordBatch(port);
+    if (batch == nullptr) {
+        _recordBatches.push_back({port, 0, {}, {}});
+        batch = &_recordBatches.back();
+    }
+
+    if (batch->payload.size() + record.size() + 1 > maxPayloadSize()) {
+        // Frame is full for the current data rate
+        if (!flushRecords(*batch)) {
+            Log.error("Frame for port %i is full and can't be sent yet, dropping record", port);
+            return false;
+        }
+    }
+
+    if (batch->payload.empty()) {
+        batch->since = millis();
+    }
+    batch->payload.push_back(record.size());
+    batch->payload.insert(batch->payload.end(), record.begin(), record.end());
+    batch->recordSizes.push_back(record.size());
     return true;
 }
 
+bool SimpleTTN::flushRecords(uint8_t port) {
+    SimpleTTNLock lock(_mutex);
+    RecordBatch *batch = recordBatch(port);
+    return batch != nullptr && flushRecords(*batch);
+}
+
+SimpleTTNCoalescingStats SimpleTTN::coalescingStats() const {
+    SimpleTTNLock lock(_mutex);
+    return _coalescingStats;
+}
+
 void SimpleTTN::onMessage(void (*callback)(const std::vector<uint8_t> &payload, int rssi)) {
+    SimpleTTNLock lock(_mutex);
     _messageCallback = callback;
 }
 
+bool SimpleTTN::onPort(uint8_t port, SimpleTTNMessageHandler handler, void *context) {
+    SimpleTTNLock lock(_mutex);
+    if (port == 0) {
+        Log.error("Port 0 is reserved for MAC commands");
+        return false;
+    }
+    removePortHandler(port);
+    _portHandlers.push_back({port, handler, context});
+    return true;
+}
+
+void SimpleTTN::removePortHandler(uint8_t port) {
+    SimpleTTNLock lock(_mutex);
+    _portHandlers.erase(std::remove_if(_portHandlers.begin(), _portHandlers.end(),
+        [port](const PortHandler &handler) { return handler.port == port; }), _portHandlers.end());
+}
+
+void SimpleTTN::onAnyPort(SimpleTTNMessageHandler handler, void *context) {
+    SimpleTTNLock lock(_mutex);
+    _anyPortHandler = {0, handler, context};
+}
+
+void SimpleTTN::onMacOnly(SimpleTTNMessageHandler handler, void *context) {
+    SimpleTTNLock lock(_mutex);
+    _macOnlyHandler = {0, handler, context};
+}
+
+bool SimpleTTN::joinMulticastGroup(uint8_t group, const char *address, const char *networkKey,
+                                   const char *appSessionKey, uint32_t sequenceNumberDown) {
+    SimpleTTNLock lock(_mutex);
+#if LMIC_MULTICAST_GROUPS > 0
+    std::array<uint8_t, 4> addressBytes;
+    std::array<uint8_t, 16> networkKeyBytes;
+    std::array<uint8_t, 16> appSessionKeyBytes;
+    if (!SimpleTTNHex::parse(address, addressBytes) || !SimpleTTNHex::parse(networkKey, networkKeyBytes) ||
+        !SimpleTTNHex::parse(appSessionKey, appSessionKeyBytes)) {
+        Log.error("Invalid session for multicast group %i", group);
+        return false;
+    }
+
+    uint32_t swappedAddress = addressBytes[0] << 24 | addressBytes[1] << 16 | addressBytes[2] << 8 | addressBytes[3];
+    if (!LMIC_setMulticastSession(group, swappedAddress, networkKeyBytes.data(),
+                                  appSessionKeyBytes.data(), sequenceNumberDown)) {
+        Log.error("Can't join multicast group %i with address %s", group, address);
+        return false;
+    }
+    Log.trace("Joined multicast group %i with address %s", group, address);
+    return true;
+#else
+    Log.error("Multicast is disabled, LMIC_MULTICAST_GROUPS is 0");
+    return false;
+#endif
+}
+
+void SimpleTTN::leaveMulticastGroup(uint8_t group) {
+    SimpleTTNLock lock(_mutex);
+#if LMIC_MULTICAST_GROUPS > 0
+    LMIC_clearMulticastSession(group);
+#endif
+}
+
+void SimpleTTN::onMulticast(SimpleTTNMulticastHandler handler, void *context) {
+    SimpleTTNLock lock(_mutex);
+    _multicastHandler = handler;
+    _multicastContext = context;
+}
+
+void SimpleTTN::enableFragmentation(const SimpleTTNFragmentStorage &storage, SimpleTTNBlockHandler handler,
+                                    void *context, uint16_t maxFragments, uint16_t maxLost) {
+    SimpleTTNLock lock(_mutex);
+    _fragmentationEnabled = true;
+    _fragmentStorage = storage;
+    _blockHandler = handler;
+    _blockContext = context;
+    // Fragment numbers have 14 bits
+    _maxFragments = std::min<uint16_t>(maxFragments, 0x3FFF);
+    _maxLostFragments = maxLost;
+}
+
+SimpleTTNFragmentStatus SimpleTTN::fragmentationStatus() const {
+    SimpleTTNLock lock(_mutex);
+    return _fragmentDecoder.status();
+}
+
+SimpleTTNFollowUpStats SimpleTTN::followUpStats() const {
+    SimpleTTNLock lock(_mutex);
+    return _followUpStats;
+}
+
+SimpleTTNDownlinkStats SimpleTTN::downlinkStats() const {
+    SimpleTTNLock lock(_mutex);
+    return _downlinkStats;
+}
+
+bool SimpleTTN::classBActive() const {
+    SimpleTTNLock lock(_mutex);
+#if !defined(DISABLE_PING)
+    return (LMIC.opmode & (OP_TRACK | OP_PINGABLE)) == (OP_TRACK | OP_PINGABLE);
+#else
+    return false;
+#endif
+}
+
+uint32_t SimpleTTN::taskStackUnused() const {
+    if (_taskHandle == nullptr) {
+        return 0;
+    }
+    // ESP-IDF measures stacks in bytes
+    return uxTaskGetStackHighWaterMark(_taskHandle);
+}
+
+SimpleTTNBeaconStats SimpleTTN::beaconStats() const {
+    SimpleTTNLock lock(_mutex);
+    return _beaconStats;
+}
+
+bool SimpleTTN::startSurvey(uint32_t interval, uint16_t dwell, int16_t busyRssi) {
+    SimpleTTNLock lock(_mutex);
+    if (dwell == 0 || dwell >= interval) {
+        Log.error("Survey dwell time must be shorter than its interval");
+        return false;
+    }
+    _survey.assign(LMIC_CHANNEL_COUNT, SimpleTTNSurveyStats());
+    _surveyInterval = interval;
+    _surveyDwell = dwell;
+    _surveyBusyRssi = busyRssi;
+    _surveyChannel = LMIC_CHANNEL_COUNT - 1;
+    _surveyJob.owner = this;
+    os_setTimedCallback(&_surveyJob.job, os_getTime() + ms2osticks(interval), surveyCallback);
+    wake();
+    return true;
+}
+
+void SimpleTTN::stopSurvey() {
+    SimpleTTNLock lock(_mutex);
+    os_clearCallback(&_surveyJob.job);
+    // Release the memory, clear() keeps it
+    std::vector<SimpleTTNSurveyStats>().swap(_survey);
+}
+
+std::vector<SimpleTTNSurveyStats> SimpleTTN::surveyStats() const {
+    SimpleTTNLock lock(_mutex);
+    std::vector<SimpleTTNSurveyStats> channels;
+    for (const SimpleTTNSurveyStats &stats : _survey) {
+        if (stats.scans > 0) {
+            channels.push_back(stats);
+        }
+    }
+    return channels;
+}
+
+SimpleTTNRadioStats SimpleTTN::radioStats() const {
+    SimpleTTNLock lock(_mutex);
+    SimpleTTNRadioStats stats;
+    stats.interrupts = LMIC.radio.irq_count;
+    if (LMIC.radio.irq_count > 0) {
+        stats.meanLatency = osticks2us(LMIC.radio.irq_latency_ticks / LMIC.radio.irq_count);
+    }
+    stats.maxLatency = osticks2us(LMIC.radio.irq_latency_max);
+#if LMIC_ENABLE_lbt_cad
+    stats.cadCycles = LMIC.radio.cad_count;
+#endif
+    return stats;
+}
+
+void SimpleTTN::onSendComplete(void (*callback)(const SimpleTTNSendResult &result)) {
+    SimpleTTNLock lock(_mutex);
+    _sendCompleteCallback = callback;
+}
+
 std::string SimpleTTN::deviceEUI() const {
-    return describe(_devEui);
+    SimpleTTNLock lock(_mutex);
+    std::array<uint8_t, 8> eui = _devEui;
+    std::reverse(eui.begin(), eui.end());
+    return describe(eui.data(), eui.size());
 }
 
 std::string SimpleTTN::appEUI() const {
-    return describe(_appEui);
+    SimpleTTNLock lock(_mutex);
+    std::array<uint8_t, 8> eui = _appEui;
+    std::reverse(eui.begin(), eui.end());
+    return describe(eui.data(), eui.size());
 }
 
 std::string SimpleTTN::appKey() const {
-    return describe(_appKey);
+    SimpleTTNLock lock(_mutex);
+    return describe(_appKey.data(), _appKey.size());
 }
 
 std::string SimpleTTN::deviceAddress() const {
-    return describe(_deviceAddress);
+    SimpleTTNLock lock(_mutex);
+    return describe(_deviceAddress.data(), _deviceAddress.size());
 }
 
 std::string SimpleTTN::networkKey() const {
-    return describe(_networkKey);
+    SimpleTTNLock lock(_mutex);
+    return describe(_networkKey.data(), _networkKey.size());
 }
 
 std::string SimpleTTN::appSessionKey() const {
-    return describe(_appSessionKey);
+    SimpleTTNLock lock(_mutex);
+    return describe(_appSessionKey.data(), _appSessionKey.size());
 }
 
 uint32_t SimpleTTN::sequenceNumberUp() const {
+    SimpleTTNLock lock(_mutex);
     return _sequenceNumberUp;
 }
 
 std::string SimpleTTN::statusDescription() {
+    SimpleTTNLock lock(_mutex);
     std::stringstream stream;
 
     stream << "-----------------------------" << std::endl;
@@ -221,6 +691,7 @@ std::string SimpleTTN::statusDescription() {
     if (_pendingMessage.size() > 0) {
         stream << "Pending message: " << describe(_pendingMessage) << std::endl;
     }
+    stream << "Queued messages: " << queuedMessages() << std::endl;
     stream << "DevEUI: " << this->deviceEUI() << std::endl;
     stream << "AppEUI: " << this->appEUI() << std::endl;
     stream << "AppKey: " << this->appKey() << std::endl;
@@ -229,6 +700,7 @@ std::string SimpleTTN::statusDescription() {
     stream << "LMIC networkKey: " << this->networkKey() << std::endl;
     stream << "LMIC appSessionKey: " << this->appSessionKey() << std::endl;
     stream << "LMIC seqNumUp: " << this->sequenceNumberUp() << std::endl;
+    stream << "Task stack unused: " << taskStackUnused() << " of " << _taskStackSize << " bytes" << std::endl;
 
     // stream << std::dec;
     // stream << "LMIC dataRate: " << _lmic_devAddr << std::endl;
@@ -244,8 +716,11 @@ std::string SimpleTTN::statusDescription() {
 
 void SimpleTTN::handleEvent_JOINING() {
     Log.trace("handleEvent_JOINING");
-    // TODO log joining
     _state = SimpleTTNStateJoining;
+    restartJoinRound();
+    if (_configuration.joinJitter > 0) {
+        LMIC.txend += ms2osticks(random(_configuration.joinJitter));
+    }
 }
 
 void SimpleTTN::handleEvent_JOINED() {
@@ -261,12 +736,13 @@ void SimpleTTN::handleEvent_JOINED() {
         (u1_t)(devAddr >> 16), 
         (u1_t)(devAddr >> 8), 
         (u1_t)(devAddr)};
-    _networkKey.assign(nwkKey, nwkKey+16);
-    _appSessionKey.assign(artKey, artKey+16);
+    std::copy(nwkKey, nwkKey + 16, _networkKey.begin());
+    std::copy(artKey, artKey + 16, _appSessionKey.begin());
 
     LMIC_setLinkCheckMode(_configuration.linkCheckEnabled ? 1 : 0);
 
-    // TODO log current state
+    _joinStats.timeToJoin = std::max<uint32_t>(millis() - _joinStartedAt, 1);
+    Log.notice("Joined after %i requests in %i ms", _joinStats.requests, _joinStats.timeToJoin);
     _state = SimpleTTNStateReady;
 }
 
@@ -277,13 +753,42 @@ void SimpleTTN::handleEvent_JOIN_TXCOMPLETE() {
 
 void SimpleTTN::handleEvent_JOIN_FAILED() {
     Log.trace("handleEvent_JOIN_FAILED");
-    // TODO Log error
-    _state = SimpleTTNStateJoinFailed;
+    _joinStats.failedRounds += 1;
+    if (_configuration.maxJoinRounds != 0 && _joinStats.failedRounds >= _configuration.maxJoinRounds) {
+        Log.error("No join accept after %i rounds, giving up", _joinStats.failedRounds);
+        // LMIC keeps joining otherwise; join() starts over
+        LMIC_shutdown();
+        _state = SimpleTTNStateJoinFailed;
+        return;
+    }
+
+    uint32_t backoff = joinBackoff(_joinStats.failedRounds);
+    Log.warning("No join accept after %i rounds, retrying in %i s", _joinStats.failedRounds, backoff / 1000);
+    restartJoinRound();
+    LMIC.txend = os_getTime() + ms2osticks(backoff);
 }
 
 void SimpleTTN::handleEvent_TXSTART() {
     Log.trace("handleEvent_TXSTART");
-
+    if (LMIC.opmode & OP_JOINING) {
+        _joinStats.requests += 1;
+        _joinStats.airtime += SimpleTTNRadioTiming::airtime(LMIC.rps, LEN_JR);
+        // LMIC already advanced the DevNonce for the next request
+        if (_devNonceCallback) {
+            _devNonceCallback(LMIC.devNonce);
+        }
+        return;
+    }
+    if (_state == SimpleTTNStateTransceiving) {
+        if (_pendingTransmissions == 0) {
+            uint32_t wait = millis() - _pendingQueuedSince;
+            SimpleTTNQueueStats &stats = _queueStats[_pendingPriority];
+            stats.messages += 1;
+            stats.totalWait += wait;
+            stats.maxWait = std::max(stats.maxWait, wait);
+        }
+        ++_pendingTransmissions;
+    }
 }
 
 void SimpleTTN::handleEvent_TXCOMPLETE() {
@@ -294,84 +799,134 @@ void SimpleTTN::handleEvent_TXCOMPLETE() {
     Log.trace("txrxFlags: %b", LMIC.txrxFlags);
     if (LMIC.txrxFlags & TXRX_ACK) {
         Log.trace("Received ACK");
-        // todo invoke callback for blocking send   
-    }
-
-    std::vector<u1_t> data;
-    if (LMIC.dataLen) {
-      u1_t offset = LMIC.dataBeg; // offset to get data.
-      data.insert(data.end(), LMIC.frame + offset, LMIC.frame + offset + LMIC.dataLen);
-      Log.trace("Received data (%i bytes, dataBeg %i): %s", LMIC.dataLen, LMIC.dataBeg, describe(data).c_str());
+    } else if (LMIC.txrxFlags & TXRX_NACK) {
+        Log.warning("Confirmed message not acknowledged after %i transmissions", _pendingTransmissions);
     }
 
     if (_state == SimpleTTNStateTransceiving) {
-        _state = SimpleTTNStateReady;
-        _pendingMessage = {};
+        completeSend((LMIC.txrxFlags & TXRX_LENERR) != 0);
+    }
+    // rxMessage() dispatched the downlink, if any, before this event; without
+    // one, there is nothing to follow up.
+    if (_followUpPending) {
+        _followUpPending = false;
+        followUp();
+    } else if ((LMIC.opmode & OP_POLL) == 0) {
+        _followUps = 0;
     }
+}
 
-    if (_messageCallback && data.size() > 0) {
-      _messageCallback(data, LMIC.rssi);
+void SimpleTTN::handleEvent_TXCANCELED() {
+    Log.trace("handleEvent_TXCANCELED");
+    if (_state == SimpleTTNStateTransceiving && !_preempting) {
+        completeSend(true);
     }
 }
 
-void SimpleTTN::taskLoop(void* parameter) {
-    for (;;) {
-        os_runloop_once();
-        vTaskDelay(16 / portTICK_PERIOD_MS); // delay 16 ms each run loop
+// Downlink received outside the windows after an uplink: in Class C, or in a
+// Class B ping slot.
+void SimpleTTN::handleEvent_RXCOMPLETE() {
+    Log.trace("handleEvent_RXCOMPLETE");
+
+    // rxMessage() dispatched the frame before this event
+    if ((LMIC.txrxFlags & TXRX_PORT) != 0 && LMIC.dataLen > 0) {
+        uint32_t latency = osticks2us(_downlinkDispatchedAt - LMIC.rxtime);
+        _downlinkStats.messages += 1;
+        _downlinkStats.totalLatency += latency;
+        _downlinkStats.maxLatency = std::max(_downlinkStats.maxLatency, latency);
+    }
+    if (_followUpPending) {
+        _followUpPending = false;
+        followUp();
     }
 }
 
-void SimpleTTN::startLoop() {
-    // TODO: Consider not pinned to core
-    xTaskCreatePinnedToCore(taskLoop, "taskLoop", 2048, (void*)1, (5 | portPRIVILEGE_BIT), &_taskHandle, 1);
+void SimpleTTN::handleEvent_BEACON_FOUND() {
+    Log.trace("handleEvent_BEACON_FOUND");
+#if !defined(DISABLE_PING)
+    _beaconSearchDelay = 0;
+    _beaconStats.received += 1;
+    _beaconStats.rssi = LMIC.bcninfo.rssi - RSSI_OFF;
+    _beaconStats.snr = LMIC.bcninfo.snr / SNR_SCALEUP;
+#endif
 }
 
-void SimpleTTN::stopLoop() {
-    vTaskDelete(_taskHandle);
-    _taskHandle = 0;
+void SimpleTTN::handleEvent_BEACON_TRACKED() {
+    Log.trace("handleEvent_BEACON_TRACKED");
+#if !defined(DISABLE_PING)
+    _beaconStats.received += 1;
+    _beaconStats.rssi = LMIC.bcninfo.rssi - RSSI_OFF;
+    _beaconStats.snr = LMIC.bcninfo.snr / SNR_SCALEUP;
+#endif
 }
 
-/// LMIC Callbacks
-void os_getArtEui(u1_t* buf) {
-    std::vector<uint8_t> b = SimpleTTN::instance()->_appEui;
-    std::reverse(b.begin(),  b.end());  
-    std::copy(b.begin(), b.end(), buf);
+void SimpleTTN::handleEvent_BEACON_MISSED() {
+    Log.trace("handleEvent_BEACON_MISSED");
+    _beaconStats.missed += 1;
 }
 
-void os_getDevEui(u1_t* buf) {
-    std::vector<uint8_t> b = SimpleTTN::instance()->_devEui;
-    std::reverse(b.begin(),  b.end());  
-    std::copy(b.begin(), b.end(), buf);
+void SimpleTTN::handleEvent_SCAN_TIMEOUT() {
+    Log.trace("handleEvent_SCAN_TIMEOUT");
+    // Searching keeps the receiver on, so back off while no beacon is around
+    const uint32_t firstDelay = 2 * 60 * 1000;
+    const uint32_t maxDelay = 60 * 60 * 1000;
+    _beaconSearchDelay = _beaconSearchDelay == 0 ? firstDelay : std::min(2 * _beaconSearchDelay, maxDelay);
+    _beaconSearchAt = millis() + _beaconSearchDelay;
+    Log.warning("No beacon found, searching again in %i s", _beaconSearchDelay / 1000);
 }
 
-void os_getDevKey(u1_t* buf) {
-    std::vector<uint8_t> b = SimpleTTN::instance()->_appKey;
-    std::copy(b.begin(), b.end(), buf);
+void SimpleTTN::handleEvent_LOST_TSYNC() {
+    Log.trace("handleEvent_LOST_TSYNC");
+    _beaconStats.lostSync += 1;
+    // The beacon was there recently, so look for it again right away
+    _beaconSearchAt = millis();
+    Log.warning("Lost beacon synchronization, falling back to Class A");
 }
 
-void onEvent(ev_t event) {
-    SimpleTTN *dev = SimpleTTN::instance();
+void SimpleTTN::handleEvent(ev_t event) {
     switch(event) {
     case EV_JOINING:
-        dev->handleEvent_JOINING();
+        handleEvent_JOINING();
         break;
     case EV_JOINED:
-        dev->handleEvent_JOINED();
+        handleEvent_JOINED();
         break;
     case EV_JOIN_TXCOMPLETE:
-        dev->handleEvent_JOIN_TXCOMPLETE();
+        handleEvent_JOIN_TXCOMPLETE();
         break;
     case EV_JOIN_FAILED:
-        dev->handleEvent_JOIN_FAILED();
+        handleEvent_JOIN_FAILED();
         break;
     case EV_TXSTART:
-        dev->handleEvent_TXSTART();
+        handleEvent_TXSTART();
         break;
     case EV_TXCOMPLETE:
-        dev->handleEvent_TXCOMPLETE();
+        handleEvent_TXCOMPLETE();
+        break;
+    case EV_TXCANCELED:
+        handleEvent_TXCANCELED();
         break;
     case EV_RXCOMPLETE:
-        // break;
+        handleEvent_RXCOMPLETE();
+        break;
+    case EV_BEACON_FOUND:
+        handleEvent_BEACON_FOUND();
+        break;
+    case EV_BEACON_TRACKED:
+        handleEvent_BEACON_TRACKED();
+        break;
+    case EV_BEACON_MISSED:
+        handleEvent_BEACON_MISSED();
+        break;
+    case EV_SCAN_TIMEOUT:
+        handleEvent_SCAN_TIMEOUT();
+        break;
+    case EV_LOST_TSYNC:
+        handleEvent_LOST_TSYNC();
+        break;
+    case EV_RXSTART:
+        // A receive window is about to open, don't delay it
+        break;
     case EV_RESET:
         // break;
     case EV_LINK_DEAD:
@@ -381,3 +936,622 @@ void onEvent(ev_t event) {
         break;
     }
 }
+
+// LMIC callback for every event, with the instance as context.
+void SimpleTTN::eventCallback(void *context, ev_t event) {
+    static_cast<SimpleTTN *>(context)->handleEvent(event);
+}
+
+// LMIC callback for every accepted downlink, called right before the event
+// that completes its reception. Frames that only carry MAC commands come with
+// port 0 and no payload.
+void SimpleTTN::rxMessage(void *context, uint8_t port, const uint8_t *payload, size_t length) {
+    static_cast<SimpleTTN *>(context)->dispatchMessage(port, payload, length);
+}
+
+void SimpleTTN::dispatchMessage(uint8_t port, const uint8_t *payload, size_t length) {
+    _downlinkDispatchedAt = os_getTime();
+#if LMIC_MULTICAST_GROUPS > 0
+    // Multicast isn't part of the unicast exchange, so it doesn't take part in follow-ups.
+    if (LMIC.dataGroup != LMIC_MULTICAST_NONE) {
+        Log.trace("Received multicast data (group %i, %i bytes, port %i): %s", LMIC.dataGroup,
+                  length, port, describe(payload, length).c_str());
+        if (_fragmentationEnabled && port == SimpleTTNFragmentationPort) {
+            handleFragmentation(payload, length, LMIC.dataGroup);
+        } else if (_multicastHandler) {
+            _multicastHandler(_multicastContext, LMIC.dataGroup, port, payload, length);
+        }
+        return;
+    }
+#endif
+    Log.trace("Received data (%i bytes, port %i): %s", length, port, describe(payload, length).c_str());
+
+    if (port == 0) {
+        if (_macOnlyHandler.handler) {
+            _macOnlyHandler.handler(_macOnlyHandler.context, port, payload, length);
+        }
+    } else if (_fragmentationEnabled && port == SimpleTTNFragmentationPort) {
+        handleFragmentation(payload, length, LMIC_MULTICAST_NONE);
+    } else {
+        const PortHandler *handler = &_anyPortHandler;
+        for (const PortHandler &portHandler : _portHandlers) {
+            if (portHandler.port == port) {
+                handler = &portHandler;
+                break;
+            }
+        }
+        if (handler->handler) {
+            handler->handler(handler->context, port, payload, length);
+        }
+        if (_messageCallback && length > 0) {
+            _messageCallback(std::vector<uint8_t>(payload, payload + length), LMIC.rssi);
+        }
+    }
+    // The event that follows updates the send state first
+    _followUpPending = true;
+}
+
+void SimpleTTN::surveyCallback(osjob_t *job) {
+    // job is the first member of its SurveyJob
+    reinterpret_cast<SurveyJob *>(job)->owner->surveyNextChannel();
+}
+
+// Scans the enabled channel after the last one scanned. If the radio isn't
+// available, the same channel is tried again at the next interval.
+void SimpleTTN::surveyNextChannel() {
+    if (_survey.empty()) {
+        return;
+    }
+    ostime_t next = os_getTime() + ms2osticks(_surveyInterval);
+    uint8_t channel = _surveyChannel;
+    uint32_t frequency = 0;
+    for (size_t i = 0; i < _survey.size() && frequency == 0; i++) {
+        channel = (channel + 1) % _survey.size();
+        frequency = LMIC_getChannelFreq(channel);
+    }
+
+    oslmic_radio_rssi_t rssi;
+    if (frequency != 0 && LMIC_monitorRssi(frequency, ms2osticks(_surveyDwell), &rssi)) {
+        _surveyChannel = channel;
+        SimpleTTNSurveyStats &stats = _survey[channel];
+        if (stats.frequency != frequency) {
+            // New or moved channel
+            stats = SimpleTTNSurveyStats();
+            stats.channel = channel;
+            stats.frequency = frequency;
+            stats.minRssi = rssi.min_rssi;
+            stats.maxRssi = rssi.max_rssi;
+        }
+        stats.scans += 1;
+        stats.busy += rssi.max_rssi >= _surveyBusyRssi ? 1 : 0;
+        stats.minRssi = std::min<int16_t>(stats.minRssi, rssi.min_rssi);
+        stats.maxRssi = std::max<int16_t>(stats.maxRssi, rssi.max_rssi);
+
+        int bin = (rssi.mean_rssi - SimpleTTNSurveyMinRssi) / SimpleTTNSurveyBinWidth;
+        bin = std::max(0, std::min<int>(bin, SimpleTTNSurveyBins - 1));
+        if (stats.histogram[bin] == UINT16_MAX) {
+            for (uint16_t &count : stats.histogram) {
+                count /= 2;
+            }
+        }
+        stats.histogram[bin] += 1;
+    }
+    os_setTimedCallback(&_surveyJob.job, next, surveyCallback);
+}
+
+// Commands of the fragmented data block transport, TS004 v1.0.0
+enum {
+    FragPackageVersion = 0x00,
+    FragSessionStatus = 0x01,
+    FragSessionSetup = 0x02,
+    FragSessionDelete = 0x03,
+    FragDataFragment = 0x08
+};
+
+// Handles the commands in a downlink on SimpleTTNFragmentationPort and sends
+// their answers in one uplink. group is LMIC_MULTICAST_NONE for unicast.
+void SimpleTTN::handleFragmentation(const uint8_t *payload, size_t length, uint8_t group) {
+    std::vector<uint8_t> answer;
+    bool delayAnswer = false;
+    size_t i = 0;
+    while (i < length) {
+        uint8_t command = payload[i++];
+        size_t size = command == FragPackageVersion ? 0
+            : command == FragSessionSetup ? 10
+            : command == FragDataFragment ? 2 : 1;
+        if (length - i < size) {
+            Log.warning("Truncated fragmentation command %i", command);
+            break;
+        }
+        const uint8_t *parameters = payload + i;
+        i += size;
+
+        if (command == FragPackageVersion) {
+            // Package identifier 3, version 1
+            answer.insert(answer.end(), {FragPackageVersion, 3, 1});
+        } else if (command == FragSessionStatus) {
+            uint8_t index = (parameters[0] >> 1) & 0x3;
+            bool allParticipants = parameters[0] & 0x1;
+            const SimpleTTNFragmentStatus &status = _fragmentDecoder.status();
+            if (status.fragments == 0 || index != _fragmentSession.index ||
+                (!allParticipants && status.missing() == 0)) {
+                continue;
+            }
+            uint16_t received = std::min<uint16_t>(status.received(), 0x3FFF) | index << 14;
+            answer.insert(answer.end(), {FragSessionStatus, (uint8_t)received, (uint8_t)(received >> 8),
+                (uint8_t)std::min<uint16_t>(status.missing(), 255), (uint8_t)(status.memoryError ? 1 : 0)});
+            delayAnswer = delayAnswer || group != LMIC_MULTICAST_NONE;
+        } else if (command == FragSessionSetup) {
+            answer.insert(answer.end(), {FragSessionSetup, setupFragmentSession(parameters)});
+        } else if (command == FragSessionDelete) {
+            uint8_t index = parameters[0] & 0x3;
+            uint8_t status = index;
+            if (_fragmentDecoder.status().fragments == 0 || index != _fragmentSession.index) {
+                // Session doesn't exist
+                status |= 0x04;
+            } else {
+                Log.trace("Deleting fragmentation session %i", index);
+                _fragmentDecoder.end();
+            }
+            answer.insert(answer.end(), {FragSessionDelete, status});
+        } else if (command == FragDataFragment) {
+            // The fragment takes the rest of the frame
+            uint16_t indexAndNumber = parameters[0] | parameters[1] << 8;
+            handleFragment(indexAndNumber >> 14, indexAndNumber & 0x3FFF, payload + i, length - i, group);
+            i = length;
+        } else {
+            Log.warning("Unknown fragmentation command %i", command);
+            break;
+        }
+    }
+
+    if (answer.empty()) {
+        return;
+    }
+    if (delayAnswer) {
+        // Up to 2^(BlockAckDelay + 4) seconds
+        _fragmentAnswer = answer;
+        _fragmentAnswerAt = millis() + random(1000l << (_fragmentSession.ackDelay + 4));
+        wake();
+    } else {
+        send(answer, SimpleTTNFragmentationPort, false, SimpleTTNPriorityHigh);
+    }
+}
+
+// Returns the status byte of FragSessionSetupAns.
+uint8_t SimpleTTN::setupFragmentSession(const uint8_t *parameters) {
+    uint8_t index = (parameters[0] >> 4) & 0x3;
+    uint16_t fragments = parameters[1] | parameters[2] << 8;
+    uint8_t fragmentSize = parameters[3];
+    uint8_t control = parameters[4];
+    const SimpleTTNFragmentStatus &current = _fragmentDecoder.status();
+
+    uint8_t status = index << 6;
+    if (((control >> 3) & 0x7) != 0) {
+        // Only the parity matrix of TS004 is supported
+        status |= 0x01;
+    }
+    if (fragments == 0 || fragments > _maxFragments || fragmentSize == 0) {
+        status |= 0x02;
+    }
+    if (current.fragments != 0 && !current.complete && index != _fragmentSession.index) {
+        // One block at a time
+        status |= 0x04;
+    }
+    if ((status & 0x0F) == 0 &&
+        !_fragmentDecoder.begin(fragments, fragmentSize, _maxLostFragments, _fragmentStorage)) {
+        status |= 0x02;
+    }
+    if ((status & 0x0F) != 0) {
+        Log.warning("Refused fragmentation session %i (%i fragments of %i bytes): status %i",
+                    index, fragments, fragmentSize, status & 0x0F);
+        return status;
+    }
+
+    _fragmentSession.index = index;
+    _fragmentSession.groups = parameters[0] & 0x0F;
+    _fragmentSession.padding = parameters[5];
+    _fragmentSession.ackDelay = control & 0x7;
+    _fragmentSession.descriptor = parameters[6] | parameters[7] << 8 | parameters[8] << 16 |
+        (uint32_t)parameters[9] << 24;
+    Log.trace("Fragmentation session %i: %i fragments of %i bytes, %i bytes of RAM", index,
+              fragments, fragmentSize, _fragmentDecoder.memoryUsage());
+    return status;
+}
+
+void SimpleTTN::handleFragment(uint8_t index, uint16_t number, const uint8_t *data, size_t length, uint8_t group) {
+    const SimpleTTNFragmentStatus &status = _fragmentDecoder.status();
+    if (status.fragments == 0 || index != _fragmentSession.index || status.complete ||
+        status.memoryError || status.storageError) {
+        return;
+    }
+    if (group != LMIC_MULTICAST_NONE && (_fragmentSession.groups & (1 << group)) == 0) {
+        return;
+    }
+
+    SimpleTTNFragmentResult result = _fragmentDecoder.process(number, data, length);
+    if (result == SimpleTTNFragmentComplete) {
+        uint32_t size = (uint32_t)status.fragments * status.fragmentSize - _fragmentSession.padding;
+        Log.notice("Received block of %i bytes in %i fragments, recovered %i lost ones",
+                   size, status.received(), status.lost);
+        if (_blockHandler) {
+            _blockHandler(_blockContext, size, _fragmentSession.descriptor);
+        }
+    } else if (result == SimpleTTNFragmentFailed) {
+        Log.error("Fragmented block failed: %s", status.memoryError ? "too many fragments lost" : "storage error");
+    }
+}
+
+// Called by the event that completes a downlink, after rxMessage() dispatched
+// it. If it was confirmed or had more downlinks pending, LMIC has set OP_POLL
+// and sends an uplink once the event returns; fill it with application data,
+// or drop it past maxFollowUps.
+void SimpleTTN::followUp() {
+    if ((LMIC.opmode & OP_POLL) == 0) {
+        _followUps = 0;
+        return;
+    }
+    if (_followUps >= _configuration.maxFollowUps) {
+        Log.trace("Skipping follow-up after %i in a row", _followUps);
+        LMIC.opmode &= ~OP_POLL;
+        _followUpStats.skipped += 1;
+        _followUps = 0;
+        return;
+    }
+    ++_followUps;
+
+    // Queued messages were started when the previous send completed
+    if (_state == SimpleTTNStateReady) {
+        for (RecordBatch &batch : _recordBatches) {
+            if (!batch.payload.empty()) {
+                flushRecords(batch);
+                break;
+            }
+        }
+    }
+    if (LMIC.opmode & OP_TXDATA) {
+        _followUpStats.withData += 1;
+    } else {
+        _followUpStats.empty += 1;
+    }
+}
+
+void SimpleTTN::completeSend(bool cancelled) {
+    SimpleTTNSendResult result;
+    result.priority = _pendingPriority;
+    result.confirmed = _pendingConfirmed;
+    result.acknowledged = !cancelled && (LMIC.txrxFlags & TXRX_ACK) != 0;
+    result.cancelled = cancelled;
+    result.transmissions = _pendingTransmissions;
+    result.hasDownlink = !cancelled && (LMIC.txrxFlags & (TXRX_DNW1 | TXRX_DNW2)) != 0;
+    if (result.hasDownlink) {
+        result.rssi = LMIC.rssi - RSSI_OFF;
+        result.snr = LMIC.snr / SNR_SCALEUP;
+    }
+
+    // Clear before notifying, so the callback can send again.
+    _state = SimpleTTNStateReady;
+    _pendingMessage = {};
+    _pendingConfirmed = false;
+    _pendingTransmissions = 0;
+
+    if (_sendCompleteCallback) {
+        _sendCompleteCallback(result);
+    }
+    sendNextQueued();
+}
+
+void SimpleTTN::startSend(const QueuedMessage &message) {
+    _pendingMessage = message.payload;
+    _pendingPort = message.port;
+    _pendingPriority = message.priority;
+    _pendingQueuedSince = message.since;
+    _pendingConfirmed = message.confirm;
+    _pendingTransmissions = 0;
+    _pendingSince = millis();
+    _state = SimpleTTNStateTransceiving;
+
+    lmic_tx_error_t error = LMIC_setTxData2(_pendingPort, _pendingMessage.data(), _pendingMessage.size(),
+                                            _pendingConfirmed ? 1 : 0);
+    if (error == LMIC_ERROR_TX_BUSY) {
+        // LMIC still holds other data, such as a poll; send this one next
+        _sendQueues[message.priority].push_front(message);
+        _state = SimpleTTNStateReady;
+        _pendingMessage = {};
+        return;
+    }
+    if (error != 0) {
+        Log.error("Can't send message of %i bytes: error %i", _pendingMessage.size(), error);
+        // LMIC may have reported the failure already
+        if (_state == SimpleTTNStateTransceiving) {
+            completeSend(true);
+        }
+    }
+}
+
+bool SimpleTTN::preemptSend() {
+    // Only data that is still waiting for a channel can be replaced: once
+    // OP_TXRXPEND is set the frame is on air, and a retransmission must not
+    // be interrupted.
+    if (!(LMIC.opmode & OP_TXDATA) || (LMIC.opmode & (OP_TXRXPEND | OP_JOINING)) ||
+        LMIC.txCnt != 0 || LMIC.upRepeatCount != 0 || _pendingTransmissions != 0) {
+        return false;
+    }
+
+    Log.trace("Replacing pending %s priority message", describe(_pendingPriority).c_str());
+    _sendQueues[_pendingPriority].push_front(
+        {_pendingMessage, _pendingPort, _pendingConfirmed, _pendingPriority, _pendingQueuedSince});
+
+    // Reports EV_TXCANCELED, which is ignored while preempting
+    _preempting = true;
+    LMIC_clrTxData();
+    _preempting = false;
+
+    _state = SimpleTTNStateReady;
+    return true;
+}
+
+void SimpleTTN::sendNextQueued() {
+    if (_state != SimpleTTNStateReady || (LMIC.opmode & (OP_TXRXPEND | OP_TXDATA))) {
+        return;
+    }
+    for (int priority = SimpleTTNPriorityCount - 1; priority >= 0; --priority) {
+        std::deque<QueuedMessage> &queue = _sendQueues[priority];
+        if (!queue.empty()) {
+            QueuedMessage message = queue.front();
+            queue.pop_front();
+            startSend(message);
+            return;
+        }
+    }
+}
+
+SimpleTTN::RecordBatch *SimpleTTN::recordBatch(uint8_t port) {
+    for (RecordBatch &batch : _recordBatches) {
+        if (batch.port == port) {
+            return &batch;
+        }
+    }
+    return nullptr;
+}
+
+bool SimpleTTN::flushRecords(RecordBatch &batch) {
+    if (batch.payload.empty()) {
+        return true;
+    }
+    if (!send(batch.payload, batch.port)) {
+        return false;
+    }
+
+    // Compare against one frame per record, at the data rate the frame is sent at.
+    // A single record costs its length byte, which may add a symbol group, so
+    // nothing is saved then.
+    uint32_t separateAirtime = 0;
+    for (uint8_t size : batch.recordSizes) {
+        separateAirtime += SimpleTTNConfiguredRegion::airtime(LMIC.datarate, OFF_DAT_OPTS + 5 + size);
+    }
+    uint32_t batchAirtime =
+        SimpleTTNConfiguredRegion::airtime(LMIC.datarate, OFF_DAT_OPTS + 5 + batch.payload.size());
+    uint32_t savedAirtime = separateAirtime > batchAirtime ? separateAirtime - batchAirtime : 0;
+
+    _coalescingStats.records += batch.recordSizes.size();
+    _coalescingStats.frames += 1;
+    _coalescingStats.airtimeSaved += savedAirtime;
+    Log.trace("Sent %i records on port %i, saved %i us of airtime",
+        batch.recordSizes.size(), batch.port, savedAirtime);
+
+    batch.payload.clear();
+    batch.recordSizes.clear();
+    return true;
+}
+
+uint8_t SimpleTTN::maxPayloadSize() {
+#if LMIC_ENABLE_TxParamSetupReq
+    bool dwellTime = SimpleTTNConfiguredRegion::uplinkDwellTime(LMIC.txParam);
+#else
+    bool dwellTime = false;
+#endif
+    return SimpleTTNConfiguredRegion::maxPayloadSize(LMIC.datarate, dwellTime);
+}
+
+void SimpleTTN::service() {
+    if (_joinRequested) {
+        _joinRequested = false;
+        startJoining();
+    }
+
+    if (_state == SimpleTTNStateTransceiving && _configuration.sendTimeout != 0 &&
+        millis() - _pendingSince > _configuration.sendTimeout) {
+        Log.warning("Send timed out after %i transmissions, cancelling", _pendingTransmissions);
+        // Reports EV_TXCANCELED if LMIC still holds the message
+        LMIC_clrTxData();
+        if (_state == SimpleTTNStateTransceiving) {
+            completeSend(true);
+        }
+    }
+
+    if (!_fragmentAnswer.empty() && (int32_t)(millis() - _fragmentAnswerAt) >= 0) {
+        send(_fragmentAnswer, SimpleTTNFragmentationPort, false, SimpleTTNPriorityHigh);
+        _fragmentAnswer.clear();
+    }
+
+    sendNextQueued();
+    serviceClassB();
+    runProducers();
+
+    for (RecordBatch &batch : _recordBatches) {
+        if (_state == SimpleTTNStateReady && !batch.payload.empty() &&
+            millis() - batch.since >= _configuration.coalescingLatency) {
+            flushRecords(batch);
+        }
+    }
+}
+
+void SimpleTTN::runProducers() {
+    uint32_t now = millis();
+    for (Producer &producer : _producers) {
+        if ((int32_t)(now - producer.due) < 0) {
+            continue;
+        }
+        // Don't sample while another uplink is waiting for the radio
+        if (_state != SimpleTTNStateReady || queuedMessages() > 0) {
+            continue;
+        }
+        int32_t wait = nextTxTime(producer.payloadLength);
+        if (wait > 0) {
+            producer.due = now + wait;
+            continue;
+        }
+
+        producer.due = now + producer.interval;
+        std::vector<uint8_t> payload;
+        if (producer.produce(payload)) {
+            producer.payloadLength = payload.size();
+            send(payload, producer.port, false, producer.priority);
+        }
+    }
+}
+
+// Starts searching for a beacon when Class B is configured but no beacon is
+// tracked, and announces Class B to the network once one is.
+void SimpleTTN::serviceClassB() {
+#if !defined(DISABLE_PING)
+    if (!_configuration.classB || _state != SimpleTTNStateReady) {
+        return;
+    }
+    const uint16_t busy = OP_TXDATA | OP_POLL | OP_TXRXPEND | OP_JOINING;
+    if (LMIC.opmode & (OP_TRACK | OP_SCAN)) {
+        // Ping slots start after the next uplink, which carries the Class B bit
+        // and the ping slot periodicity
+        if ((LMIC.opmode & (OP_TRACK | OP_PINGINI)) == OP_TRACK && (LMIC.opmode & busy) == 0) {
+            LMIC_sendAlive();
+        }
+        return;
+    }
+    // Searching takes over the radio and would cancel a pending transaction
+    if ((LMIC.opmode & busy) != 0 || queuedMessages() > 0 ||
+        (int32_t)(millis() - _beaconSearchAt) < 0) {
+        return;
+    }
+
+    Log.trace("Searching for a beacon");
+    _beaconStats.searches += 1;
+    LMIC_setPingable(_configuration.pingSlotPeriodicity);
+    if ((LMIC.opmode & OP_SCAN) == 0) {
+        Log.warning("Couldn't start searching for a beacon");
+        _beaconSearchAt = millis() + 60 * 1000;
+    }
+#endif
+}
+
+uint32_t SimpleTTN::idleTime() {
+    const uint32_t pollTime = 16;
+    // Upper bound, so the HAL clock is read often enough to track overflows
+    // where it isn't derived from a 64-bit timer
+    const uint32_t maxIdleTime = 60 * 1000;
+
+#if !defined(LMIC_USE_INTERRUPTS)
+    // Radio events are polled, so keep polling while a transaction is on air
+    // or the radio listens in Class C or for a beacon. With interrupts, the
+    // DIO interrupt wakes the task instead.
+    if (LMIC.opmode & (OP_TXRXPEND | OP_CLASSC | OP_SCAN)) {
+        return pollTime;
+    }
+#endif
+
+    uint32_t idle = maxIdleTime;
+    ostime_t deadline;
+    if (os_queryNextDeadline(&deadline)) {
+        ostime_t wait = deadline - os_getTime();
+        idle = std::min<uint32_t>(idle, wait > 0 ? osticks2ms(wait) : 0);
+    } else if (LMIC.opmode & OP_TRACK) {
+#if !defined(LMIC_USE_INTERRUPTS)
+        // Between windows, the next beacon or ping slot is always scheduled. Without
+        // a deadline, a window is open and its job waits for the radio.
+        return pollTime;
+#endif
+    }
+
+    uint32_t now = millis();
+    auto until = [now](uint32_t due) {
+        return (int32_t)(due - now) > 0 ? due - now : 0;
+    };
+    if (_state == SimpleTTNStateTransceiving && _configuration.sendTimeout != 0) {
+        idle = std::min(idle, until(_pendingSince + _configuration.sendTimeout));
+    }
+    if (_state == SimpleTTNStateReady && queuedMessages() > 0) {
+        idle = std::min(idle, pollTime);
+    }
+    for (const RecordBatch &batch : _recordBatches) {
+        if (!batch.payload.empty()) {
+            idle = std::min(idle, until(batch.since + _configuration.coalescingLatency));
+        }
+    }
+    for (const Producer &producer : _producers) {
+        idle = std::min(idle, std::max(until(producer.due), pollTime));
+    }
+    if (!_fragmentAnswer.empty()) {
+        idle = std::min(idle, until(_fragmentAnswerAt));
+    }
+    return idle;
+}
+
+// Called from the DIO interrupt handler: wakes the TTN task, which services
+// the radio as soon as it runs.
+void IRAM_ATTR SimpleTTN::radioInterrupt(void *context) {
+    SimpleTTN *dev = static_cast<SimpleTTN *>(context);
+    if (dev->_taskHandle == nullptr) {
+        return;
+    }
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(dev->_taskHandle, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void SimpleTTN::wake() {
+    if (_taskHandle != nullptr) {
+        xTaskNotifyGive(_taskHandle);
+    }
+}
+
+void SimpleTTN::taskLoop(void* parameter) {
+    SimpleTTN *dev = static_cast<SimpleTTN *>(parameter);
+    for (;;) {
+        uint32_t idleTime;
+        {
+            SimpleTTNLock lock(dev->_mutex);
+            os_runloop_once();
+            dev->service();
+            idleTime = dev->idleTime();
+        }
+        // Sleep until the next LMIC job or scheduled send, or until woken by a new request
+        ulTaskNotifyTake(pdTRUE, std::max<TickType_t>(1, pdMS_TO_TICKS(idleTime)));
+    }
+}
+
+void SimpleTTN::startLoop() {
+    // TODO: Consider not pinned to core
+    _taskStackSize = _configuration.taskStackSize;
+    xTaskCreatePinnedToCore(taskLoop, "taskLoop", _taskStackSize, this, (5 | portPRIVILEGE_BIT), &_taskHandle, 1);
+}
+
+void SimpleTTN::stopLoop() {
+    vTaskDelete(_taskHandle);
+    _taskHandle = 0;
+}
+
+/// LMIC Callbacks
+// Keys are stored in LMIC byte order, so these are plain copies.
+void os_getArtEui(u1_t* buf) {
+    memcpy(buf, SimpleTTN::instance()->_appEui.data(), 8);
+}
+
+void os_getDevEui(u1_t* buf) {
+    memcpy(buf, SimpleTTN::instance()->_devEui.data(), 8);
+}
+
+void os_getDevKey(u1_t* buf) {
+    memcpy(buf, SimpleTTN::instance()->_appKey.data(), 16);
+}
@@ -3,7 +3,12 @@
 
 #include "Arduino.h"
 #include "lmic/lmic.h"
+
+#include <array>
+#include <deque>
 #include "lmic/arduino_lmic_hal_boards.h"
+#include "SimpleTTNFragmentDecoder.h"
+#include "SimpleTTNHex.h"
 
 enum SimpleTTNState {
     SimpleTTNStateIdle,
@@ -18,11 +23,291 @@ enum SimpleTTNState {
     SimpleTTNStateDisconnected
 };
 
+// Uplinks of a higher priority are sent before queued uplinks of a lower one,
+// and replace a lower priority uplink that is still waiting to go on air.
+enum SimpleTTNPriority {
+    SimpleTTNPriorityLow,
+    SimpleTTNPriorityNormal,
+    SimpleTTNPriorityHigh,
+
+    SimpleTTNPriorityCount
+};
+
+// LoRaWAN regional parameters. LMIC is built for a single band plan, selected in
+// project_config/lmic_project_config.h; see SimpleTTN::region().
+enum SimpleTTNRegion {
+    SimpleTTNRegionDefault = 0,
+
+    SimpleTTNRegionEU868 = LMIC_REGION_eu868,
+    SimpleTTNRegionUS915 = LMIC_REGION_us915,
+    SimpleTTNRegionAU915 = LMIC_REGION_au915,
+    SimpleTTNRegionAS923 = LMIC_REGION_as923,
+    SimpleTTNRegionKR920 = LMIC_REGION_kr920,
+    SimpleTTNRegionIN866 = LMIC_REGION_in866
+};
+
+// Default bytes of stack of the task that runs LMIC and SimpleTTN. Besides
+// LMIC, the task runs the callbacks, handlers and producers, log formatting,
+// fragment decoding and the channel survey.
+static constexpr uint32_t SimpleTTNTaskStackSize = 8192;
+
 // For more information: http://wiki.lahoud.fr/lib/exe/fetch.php?media=lmic-v1.5.pdf
 struct SimpleTTNConfiguration {
+    // Region the device operates in. Must be the band plan LMIC was built for;
+    // SimpleTTNRegionDefault accepts whichever that is.
+    SimpleTTNRegion region = SimpleTTNRegionDefault;
+
     // Periodically checks whether a connection is established.
     // Defaults to false because of incomplete support (default true in LMIC);
     bool linkCheckEnabled = false;
+
+    // Maximum number of transmissions of a confirmed uplink, including the first one.
+    // Every retransmission costs airtime, so keep this low for periodic data.
+    uint8_t confirmedTransmissions = TXCONF_ATTEMPTS;
+
+    // Time in milliseconds after which a pending send is cancelled, 0 to wait forever.
+    uint32_t sendTimeout = 0;
+
+    // Maximum time in milliseconds a record queued with sendRecord() waits
+    // for other records before its frame is sent.
+    uint32_t coalescingLatency = 60 * 1000;
+
+    // Maximum number of uplinks waiting behind the one being sent.
+    uint8_t sendQueueSize = 8;
+
+    // Prefer channels with better delivery (acknowledgements, LBT results) when
+    // picking the channel for an uplink. Duty cycle limits still apply.
+    // Needs LMIC built with LMIC_ENABLE_channel_stats.
+    bool adaptiveChannels = false;
+
+    // In regions with listen before talk (AS923 in Japan, KR920), check the
+    // channel with the radio's channel activity detection instead of sampling
+    // its RSSI, so the CPU is free during the check. CAD only notices LoRa
+    // signals, so use it only where the regulations accept that.
+    bool lbtChannelActivityDetection = false;
+
+    // Keep receiving on the RX2 frequency and data rate between uplinks (LoRaWAN
+    // Class C), so downlinks are delivered right away instead of after the next
+    // uplink. The radio is never idle, so this is meant for mains-powered devices.
+    // The device also has to be registered as Class C in the network server.
+    bool classC = false;
+
+    // Open short receive windows (ping slots) timed by the gateways' beacons
+    // (LoRaWAN Class B), so downlinks wait at most one ping period, at a small
+    // fraction of the energy of Class C. Searching for a beacon keeps the receiver
+    // on for up to 129 s and holds back uplinks meanwhile; after a failed search
+    // the next one waits longer. The device also has to be registered as Class B
+    // in the network server. Not available if LMIC is built with DISABLE_PING.
+    bool classB = false;
+    // Ping slots open every 2^pingSlotPeriodicity seconds, from 0 to 7.
+    uint8_t pingSlotPeriodicity = 7;
+
+    // When a downlink is confirmed or the network has more downlinks pending,
+    // LMIC sends an uplink right away. Such follow-ups carry queued messages or
+    // coalesced records if there are any. This limits how many are sent in a
+    // row; after that, pending downlinks and the acknowledgement wait for the
+    // next regular uplink.
+    uint8_t maxFollowUps = 4;
+
+    // OTAA joins. LMIC sends join requests from the starting data rate down to the
+    // lowest one. Once such a round gets no answer, the next one waits joinBackoff
+    // milliseconds, doubled after each failed round up to joinBackoffMax, plus up to
+    // half of that at random, so devices that rebooted together spread out.
+    uint32_t joinBackoff = 60 * 1000;
+    uint32_t joinBackoffMax = 60 * 60 * 1000;
+    // Random delay in milliseconds before the first join request. Set it for fleets
+    // that power up at the same time.
+    uint32_t joinJitter = 0;
+    // Failed rounds before giving up with SimpleTTNStateJoinFailed, 0 to keep trying.
+    uint8_t maxJoinRounds = 0;
+    // Data rate each round starts at, -1 for the region default. Not available in
+    // US915 and AU915, which use fixed join data rates.
+    int8_t joinDataRate = -1;
+
+    // Bytes of stack of the TTN task. Applies when the task starts, in join() or
+    // provisionABP(); check SimpleTTN::taskStackUnused() before lowering it.
+    uint32_t taskStackSize = SimpleTTNTaskStackSize;
+};
+
+// Outcome of a call to send(), reported through onSendComplete().
+struct SimpleTTNSendResult {
+    SimpleTTNPriority priority = SimpleTTNPriorityNormal;
+    // Whether the message was sent as a confirmed uplink.
+    bool confirmed = false;
+    // Confirmed uplinks only: whether the network acknowledged the message.
+    bool acknowledged = false;
+    // Whether the send was cancelled before completing (timeout or frame not feasible).
+    bool cancelled = false;
+    // Number of times the frame went on air, including retransmissions.
+    uint8_t transmissions = 0;
+
+    // Signal of the downlink received after the last transmission, if any.
+    bool hasDownlink = false;
+    int rssi = 0;
+    int snr = 0;
+};
+
+// Statistics for records coalesced by sendRecord().
+struct SimpleTTNCoalescingStats {
+    uint32_t records = 0;
+    uint32_t frames = 0;
+    // Airtime in microseconds saved compared to sending each record in its own frame.
+    uint32_t airtimeSaved = 0;
+
+    uint32_t airtimeSavedPerRecord() const {
+        return records > 0 ? airtimeSaved / records : 0;
+    }
+};
+
+// Time uplinks of one priority spent between send() and going on air.
+struct SimpleTTNQueueStats {
+    uint32_t messages = 0;
+    // Milliseconds
+    uint32_t totalWait = 0;
+    uint32_t maxWait = 0;
+
+    uint32_t averageWait() const {
+        return messages > 0 ? totalWait / messages : 0;
+    }
+};
+
+// Downlinks received while listening in Class C or in Class B ping slots, and
+// the time from the end of each frame until it was dispatched to the handlers.
+struct SimpleTTNDownlinkStats {
+    uint32_t messages = 0;
+    // Microseconds
+    uint32_t totalLatency = 0;
+    uint32_t maxLatency = 0;
+
+    uint32_t averageLatency() const {
+        return messages > 0 ? totalLatency / messages : 0;
+    }
+};
+
+// Receives the downlinks of a port. The payload points into LMIC's frame
+// buffer and is only valid during the call.
+typedef void (*SimpleTTNMessageHandler)(void *context, uint8_t port, const uint8_t *payload, size_t length);
+
+// Receives the downlinks of the multicast groups the device is a member of.
+typedef void (*SimpleTTNMulticastHandler)(void *context, uint8_t group, uint8_t port,
+                                          const uint8_t *payload, size_t length);
+
+// Port of the fragmented data block transport (LoRaWAN TS004).
+const uint8_t SimpleTTNFragmentationPort = 201;
+
+// Called when a fragmented data block is complete in storage. size excludes the
+// padding of the last fragment; descriptor is set by the sender of the block.
+typedef void (*SimpleTTNBlockHandler)(void *context, uint32_t size, uint32_t descriptor);
+
+// Uplinks sent because a downlink was confirmed or had more downlinks pending.
+struct SimpleTTNFollowUpStats {
+    // Follow-ups that carried application data
+    uint32_t withData = 0;
+    // Follow-ups sent without payload
+    uint32_t empty = 0;
+    // Follow-ups left out because of SimpleTTNConfiguration::maxFollowUps
+    uint32_t skipped = 0;
+
+    uint32_t requests() const {
+        return withData + empty + skipped;
+    }
+};
+
+// OTAA join requests since the last call to join().
+struct SimpleTTNJoinStats {
+    uint32_t requests = 0;
+    // Rounds down to the lowest data rate that weren't answered
+    uint32_t failedRounds = 0;
+    // Microseconds
+    uint32_t airtime = 0;
+    // Milliseconds from join() until the network accepted, 0 until then
+    uint32_t timeToJoin = 0;
+};
+
+// Radio interrupts since initialization.
+struct SimpleTTNRadioStats {
+    uint32_t interrupts = 0;
+    // Microseconds from a DIO edge until the radio was serviced by the TTN task.
+    // Only measured if LMIC is built with LMIC_USE_INTERRUPTS.
+    uint32_t meanLatency = 0;
+    uint32_t maxLatency = 0;
+    // Channel activity detection cycles run for listen before talk
+    uint32_t cadCycles = 0;
+};
+
+// Class B beacon tracking.
+struct SimpleTTNBeaconStats {
+    // Beacon searches started
+    uint32_t searches = 0;
+    uint32_t received = 0;
+    uint32_t missed = 0;
+    // Times tracking was given up after missing too many beacons
+    uint32_t lostSync = 0;
+
+    // Signal of the last beacon received
+    int rssi = 0;
+    int snr = 0;
+};
+
+// Delivery statistics of one uplink channel. Counts are per transmission and
+// are halved periodically, so they reflect recent conditions.
+struct SimpleTTNChannelStats {
+    uint8_t channel = 0;
+    // Hz, 0 if the channel is disabled
+    uint32_t frequency = 0;
+    uint16_t uplinks = 0;
+    uint16_t confirmed = 0;
+    uint16_t acknowledged = 0;
+    uint16_t downlinks = 0;
+    // Transmissions not sent because listen-before-talk found the channel busy
+    uint16_t busy = 0;
+};
+
+// Histogram of a channel survey: SimpleTTNSurveyBins bins of SimpleTTNSurveyBinWidth
+// dB, the first one starting at SimpleTTNSurveyMinRssi dBm.
+static constexpr uint8_t SimpleTTNSurveyBins = 32;
+static constexpr int16_t SimpleTTNSurveyBinWidth = 3;
+static constexpr int16_t SimpleTTNSurveyMinRssi = -139;
+
+// Noise measured on one uplink channel by the survey (see SimpleTTN::startSurvey()).
+// Each scan samples the RSSI for the survey's dwell time.
+struct SimpleTTNSurveyStats {
+    uint8_t channel = 0;
+    // Hz
+    uint32_t frequency = 0;
+    uint32_t scans = 0;
+    // Scans whose peak reached the survey's busy threshold
+    uint32_t busy = 0;
+    // dBm, over all scans
+    int16_t minRssi = 0;
+    int16_t maxRssi = 0;
+    // Mean RSSI of each scan. Counts are halved when one would overflow, so
+    // the proportions are kept.
+    std::array<uint16_t, SimpleTTNSurveyBins> histogram{};
+
+    // RSSI in dBm that the mean of percent % of the scans didn't exceed, rounded
+    // up to the bin width. The median noise floor is percentile(50).
+    int16_t percentile(uint8_t percent) const {
+        uint32_t total = 0;
+        for (uint16_t count : histogram) {
+            total += count;
+        }
+        uint32_t needed = (total * percent + 99) / 100;
+        if (needed == 0) {
+            needed = 1;
+        }
+        uint32_t seen = 0;
+        uint8_t bin = 0;
+        while (bin < SimpleTTNSurveyBins - 1 && (seen += histogram[bin]) < needed) {
+            bin++;
+        }
+        return SimpleTTNSurveyMinRssi + (bin + 1) * SimpleTTNSurveyBinWidth;
+    }
+
+    // Percentage of scans that found the channel in use.
+    uint8_t occupancyPercent() const {
+        return scans > 0 ? (uint64_t)busy * 100 / scans : 0;
+    }
 };
 
 class SimpleTTN {
@@ -38,20 +323,114 @@ private:
 public:
     SimpleTTNState state();
 
-    // TODO add retry support
     // returns false if keys are bad
     bool ready();
-    void configure(SimpleTTNConfiguration configuration = SimpleTTNConfiguration());
-    bool provisionOTAA(std::string devEui, std::string appEui, std::string appKey);
-    bool provisionABP(std::string deviceAddress, std::string networkKey, 
-                       std::string appSessionKey, u4_t sequenceNumberUp = 0);
+    // Returns false if the configured region isn't supported by this build.
+    bool configure(SimpleTTNConfiguration configuration = SimpleTTNConfiguration());
+    // Band plan LMIC was built for.
+    static SimpleTTNRegion region();
+    // Keys and EUIs are hex strings, most significant byte first (see SimpleTTNHex).
+    // Return false if one isn't valid.
+    bool provisionOTAA(const char *devEui, const char *appEui, const char *appKey);
+    bool provisionABP(const char *deviceAddress, const char *networkKey,
+                      const char *appSessionKey, u4_t sequenceNumberUp = 0);
     bool join();
+    SimpleTTNJoinStats joinStats() const;
+    // DevNonce of the next join request. LMIC starts from a random one, which the
+    // network rejects if it was used before; restore the stored value before join().
+    void setDevNonce(uint16_t devNonce);
+    uint16_t devNonce() const;
+    // Called when a join request goes on air with the next DevNonce, to store it.
+    void onDevNonceUsed(void (*callback)(uint16_t nextDevNonce));
     void stop();
 
     bool poll(uint8_t port, bool confirm = false);
-    bool send(const std::vector<uint8_t> &message, uint8_t port, bool confirm = false);
+    // Sends the message as soon as possible. If another uplink is pending, the
+    // message is queued behind uplinks of the same or higher priority; a pending
+    // uplink of lower priority that hasn't gone on air yet is put back in the queue.
+    // Returns false if not joined or the queue is full.
+    bool send(const std::vector<uint8_t> &message, uint8_t port, bool confirm = false,
+              SimpleTTNPriority priority = SimpleTTNPriorityNormal);
+    size_t queuedMessages() const;
+
+    // Milliseconds until an uplink with a payload of the given size could go on
+    // air under the duty cycle limits, ignoring uplinks already pending or queued.
+    // Returns -1 if not joined or the payload doesn't fit the current data rate.
+    int32_t nextTxTime(uint8_t payloadLength);
+
+    // Calls producer about every interval milliseconds to fill an uplink for the
+    // port. Sampling is postponed until the duty cycle allows the uplink to go on
+    // air, so the data is fresh when sent. The producer returns false to skip it.
+    void addProducer(uint32_t interval, uint8_t port,
+                     bool (*producer)(std::vector<uint8_t> &payload),
+                     SimpleTTNPriority priority = SimpleTTNPriorityNormal);
+    void removeProducer(bool (*producer)(std::vector<uint8_t> &payload));
+    SimpleTTNQueueStats queueStats(SimpleTTNPriority priority) const;
+    // Statistics of the channels that have been used for uplinks. Empty unless
+    // LMIC is built with LMIC_ENABLE_channel_stats.
+    std::vector<SimpleTTNChannelStats> channelStats() const;
 
+    // Queues a small record to be sent in one frame together with other records
+    // for the same port. Each record is prefixed with its length; see
+    // extras/decoders/coalesced_records.js for the matching decoder.
+    bool sendRecord(const std::vector<uint8_t> &record, uint8_t port);
+    // Sends the records queued for a port without waiting for the latency deadline.
+    bool flushRecords(uint8_t port);
+    SimpleTTNCoalescingStats coalescingStats() const;
+    SimpleTTNFollowUpStats followUpStats() const;
+
+    // Called with a copy of every unicast downlink that carries application
+    // data, after the port handler.
     void onMessage(void (*callback)(const std::vector<uint8_t> &payload, int rssi));
+    // Calls handler for downlinks on the port. Replaces the port's previous handler.
+    // Returns false for port 0, which only carries MAC commands (see onMacOnly()).
+    bool onPort(uint8_t port, SimpleTTNMessageHandler handler, void *context = nullptr);
+    void removePortHandler(uint8_t port);
+    // Calls handler for downlinks on ports without a handler of their own.
+    void onAnyPort(SimpleTTNMessageHandler handler, void *context = nullptr);
+    // Calls handler, with port 0 and no payload, for downlinks that only carry
+    // MAC commands.
+    void onMacOnly(SimpleTTNMessageHandler handler, void *context = nullptr);
+    // Makes the device a member of a multicast group (0 to LMIC_MULTICAST_GROUPS - 1),
+    // with the address, keys and frame counter set up by the network server. Multicast
+    // downlinks are only sent in Class B ping slots and in Class C, and stop() drops
+    // the memberships. LMIC_MULTICAST_GROUPS is 0 unless set in the LMIC configuration.
+    bool joinMulticastGroup(uint8_t group, const char *address, const char *networkKey,
+                            const char *appSessionKey, uint32_t sequenceNumberDown = 0);
+    void leaveMulticastGroup(uint8_t group);
+    // Calls handler for multicast downlinks instead of the port handlers.
+    void onMulticast(SimpleTTNMulticastHandler handler, void *context = nullptr);
+    // Receives large blocks, such as firmware images, sent in fragments on
+    // SimpleTTNFragmentationPort over unicast or multicast. Fragments are written to
+    // storage as they arrive, and up to maxLost lost fragments are recovered from
+    // parity fragments; the RAM needed grows with maxLost squared. Sessions of more
+    // than maxFragments fragments are refused.
+    void enableFragmentation(const SimpleTTNFragmentStorage &storage, SimpleTTNBlockHandler handler,
+                             void *context = nullptr, uint16_t maxFragments = 2048, uint16_t maxLost = 128);
+    // Progress of the current block, fragments is 0 without a session.
+    SimpleTTNFragmentStatus fragmentationStatus() const;
+    SimpleTTNDownlinkStats downlinkStats() const;
+    // Whether a beacon is tracked and ping slots are open (see SimpleTTNConfiguration::classB).
+    bool classBActive() const;
+    SimpleTTNBeaconStats beaconStats() const;
+    SimpleTTNRadioStats radioStats() const;
+    // Bytes of the TTN task's stack that were never used since it started, 0
+    // if it isn't running. Used to size SimpleTTNConfiguration::taskStackSize.
+    uint32_t taskStackUnused() const;
+    // Surveys the noise on the enabled uplink channels in the background, one
+    // channel every interval milliseconds, sampling its RSSI for dwell
+    // milliseconds. Scans are skipped while the radio is needed: during
+    // transactions and receive windows, in Class C, or when an uplink, beacon or
+    // ping slot is due. A scan whose peak reaches busyRssi dBm counts as busy.
+    // Statistics take about 80 bytes per channel the region can have.
+    bool startSurvey(uint32_t interval = 1000, uint16_t dwell = 5, int16_t busyRssi = -90);
+    // Stops the survey and releases its statistics.
+    void stopSurvey();
+    // Statistics of the channels scanned so far.
+    std::vector<SimpleTTNSurveyStats> surveyStats() const;
+    void onSendComplete(void (*callback)(const SimpleTTNSendResult &result));
+    // Callbacks and handlers are called from the TTN task. They may call the
+    // methods above, but shouldn't wait for other tasks that do.
 
     // TODO configure transmission power, data rate,
     // TODO getters for mac, frequency, etc
@@ -76,36 +455,181 @@ protected:
     void handleEvent_JOIN_FAILED();
     void handleEvent_TXSTART();
     void handleEvent_TXCOMPLETE();
+    void handleEvent_TXCANCELED();
+    void handleEvent_RXCOMPLETE();
+    void handleEvent_BEACON_FOUND();
+    void handleEvent_BEACON_TRACKED();
+    void handleEvent_BEACON_MISSED();
+    void handleEvent_SCAN_TIMEOUT();
+    void handleEvent_LOST_TSYNC();
+
+    // Called periodically from the TTN task.
+    void service();
+    // Milliseconds the TTN task can sleep before LMIC or service() need to run.
+    uint32_t idleTime();
+    // Wakes the TTN task to handle a new request.
+    void wake();
+    void completeSend(bool cancelled);
+    void followUp();
+    static void eventCallback(void *context, ev_t event);
+    static void rxMessage(void *context, uint8_t port, const uint8_t *payload, size_t length);
+    static void radioInterrupt(void *context);
+    void handleEvent(ev_t event);
+    void dispatchMessage(uint8_t port, const uint8_t *payload, size_t length);
+    void handleFragmentation(const uint8_t *payload, size_t length, uint8_t group);
+    uint8_t setupFragmentSession(const uint8_t *parameters);
+    void handleFragment(uint8_t index, uint16_t number, const uint8_t *data, size_t length, uint8_t group);
+    static void surveyCallback(osjob_t *job);
+    void surveyNextChannel();
+
+    struct QueuedMessage {
+        std::vector<uint8_t> payload;
+        uint8_t port;
+        bool confirm;
+        SimpleTTNPriority priority;
+        uint32_t since;
+    };
+    void startSend(const QueuedMessage &message);
+    bool preemptSend();
+    void sendNextQueued();
+
+    struct RecordBatch {
+        uint8_t port;
+        uint32_t since;
+        std::vector<uint8_t> payload;
+        std::vector<uint8_t> recordSizes;
+    };
+    RecordBatch *recordBatch(uint8_t port);
+
+    struct Producer {
+        uint32_t interval;
+        uint8_t port;
+        SimpleTTNPriority priority;
+        bool (*produce)(std::vector<uint8_t> &payload);
+        uint32_t due;
+        uint8_t payloadLength;
+    };
+    void runProducers();
+    void serviceClassB();
+    void startJoining();
+    void restartJoinRound();
+    uint32_t joinBackoff(uint32_t failedRounds);
+    bool flushRecords(RecordBatch &batch);
+    static uint8_t maxPayloadSize();
 
     // OTAA activation
-    std::vector<uint8_t> _devEui;
-    std::vector<uint8_t> _appEui;
-    std::vector<uint8_t> _appKey;
+    // In LMIC byte order, so the EUIs are least significant byte first
+    std::array<uint8_t, 8> _devEui = {};
+    std::array<uint8_t, 8> _appEui = {};
+    std::array<uint8_t, 16> _appKey = {};
 
     // ABP / session
-    std::vector<uint8_t> _deviceAddress;
-    std::vector<uint8_t> _networkKey;
-    std::vector<uint8_t> _appSessionKey;
+    std::array<uint8_t, 4> _deviceAddress = {};
+    std::array<uint8_t, 16> _networkKey = {};
+    std::array<uint8_t, 16> _appSessionKey = {};
     uint32_t _sequenceNumberUp;
 
     SimpleTTNConfiguration _configuration;
 
     SimpleTTNState _state;
     std::vector<uint8_t> _pendingMessage;
+    uint8_t _pendingPort = 0;
+    SimpleTTNPriority _pendingPriority = SimpleTTNPriorityNormal;
+    uint32_t _pendingQueuedSince = 0;
+    bool _pendingConfirmed = false;
+    uint8_t _pendingTransmissions = 0;
+    uint32_t _pendingSince = 0;
     void (*_messageCallback)(const std::vector<uint8_t> &payload, int rssi) = nullptr;
+    void (*_sendCompleteCallback)(const SimpleTTNSendResult &result) = nullptr;
+
+    struct PortHandler {
+        uint8_t port;
+        SimpleTTNMessageHandler handler;
+        void *context;
+    };
+    std::vector<PortHandler> _portHandlers;
+    PortHandler _anyPortHandler = {0, nullptr, nullptr};
+    PortHandler _macOnlyHandler = {0, nullptr, nullptr};
+    SimpleTTNMulticastHandler _multicastHandler = nullptr;
+    void *_multicastContext = nullptr;
+
+    struct FragmentSession {
+        uint8_t index;
+        // Multicast groups allowed to carry fragments
+        uint8_t groups;
+        uint8_t padding;
+        uint8_t ackDelay;
+        uint32_t descriptor;
+    };
+    bool _fragmentationEnabled = false;
+    SimpleTTNFragmentStorage _fragmentStorage;
+    SimpleTTNBlockHandler _blockHandler = nullptr;
+    void *_blockContext = nullptr;
+    uint16_t _maxFragments = 0;
+    uint16_t _maxLostFragments = 0;
+    SimpleTTNFragmentDecoder _fragmentDecoder;
+    FragmentSession _fragmentSession = {0, 0, 0, 0, 0};
+    // Answer to a status request sent by multicast, delayed so that devices
+    // don't all answer at once
+    std::vector<uint8_t> _fragmentAnswer;
+    uint32_t _fragmentAnswerAt = 0;
+
+    std::deque<QueuedMessage> _sendQueues[SimpleTTNPriorityCount];
+    SimpleTTNQueueStats _queueStats[SimpleTTNPriorityCount];
+    // Set while a pending uplink is being replaced, so its cancellation isn't reported.
+    bool _preempting = false;
+
+    std::vector<RecordBatch> _recordBatches;
+    std::vector<Producer> _producers;
+    SimpleTTNCoalescingStats _coalescingStats;
+    SimpleTTNFollowUpStats _followUpStats;
+    // Follow-ups sent in a row
+    uint8_t _followUps = 0;
+    // Set by dispatchMessage() for the event that completes the downlink
+    bool _followUpPending = false;
+    SimpleTTNDownlinkStats _downlinkStats;
+    ostime_t _downlinkDispatchedAt = 0;
+
+    SimpleTTNJoinStats _joinStats;
+    uint32_t _joinStartedAt = 0;
+    bool _joinRequested = false;
+    void (*_devNonceCallback)(uint16_t nextDevNonce) = nullptr;
+
+    SimpleTTNBeaconStats _beaconStats;
+    // Next beacon search, and the delay applied after the next failed one
+    uint32_t _beaconSearchAt = 0;
+    uint32_t _beaconSearchDelay = 0;
+
+    // Indexed by LMIC channel, empty while no survey runs
+    std::vector<SimpleTTNSurveyStats> _survey;
+    // LMIC only passes the job to its callback, so the job carries the instance
+    struct SurveyJob {
+        osjob_t job;
+        SimpleTTN *owner;
+    };
+    SurveyJob _surveyJob = {};
+    uint32_t _surveyInterval = 0;
+    uint16_t _surveyDwell = 0;
+    int16_t _surveyBusyRssi = 0;
+    uint8_t _surveyChannel = 0;
 private:
     // Loop function for the TTN task.
     static void taskLoop(void* parameter);
     void startLoop();
     void stopLoop();
     // Task handle to manage the TTN task.
-    TaskHandle_t _taskHandle;
+    TaskHandle_t _taskHandle = nullptr;
+    // Stack size the task was started with
+    uint32_t _taskStackSize = 0;
+    // Held by the TTN task while LMIC and service() run, and by the public
+    // methods, which are called from other tasks. Recursive, because the
+    // callbacks run by the TTN task may call the public methods.
+    SemaphoreHandle_t _mutex = nullptr;
 
     // Global LMIC functions need to be friend so they can access private fields.
     friend void os_getArtEui(u1_t* buf);
     friend void os_getDevEui(u1_t* buf);
     friend void os_getDevKey(u1_t* buf);
-    friend void onEvent(ev_t event);
 };
 
 #endif // SimpleTTN_h
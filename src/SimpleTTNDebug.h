@@ -54,4 +54,38 @@ std::string describe(SimpleTTNState state) {
     }
 }
 
+std::string describe(SimpleTTNRegion region) {
+    switch(region) {
+    case SimpleTTNRegionDefault:
+        return "default";
+    case SimpleTTNRegionEU868:
+        return "eu868";
+    case SimpleTTNRegionUS915:
+        return "us915";
+    case SimpleTTNRegionAU915:
+        return "au915";
+    case SimpleTTNRegionAS923:
+        return "as923";
+    case SimpleTTNRegionKR920:
+        return "kr920";
+    case SimpleTTNRegionIN866:
+        return "in866";
+    default:
+        return "unknown";
+    }
+}
+
+std::string describe(SimpleTTNPriority priority) {
+    switch(priority) {
+    case SimpleTTNPriorityLow:
+        return "low";
+    case SimpleTTNPriorityNormal:
+        return "normal";
+    case SimpleTTNPriorityHigh:
+        return "high";
+    default:
+        return "unknown";
+    }
+}
+
 #endif // Debug_h
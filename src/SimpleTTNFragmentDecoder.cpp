@@ -0,0 +1,264 @@
+#include "SimpleTTNFragmentDecoder.h"
+
+#include <algorithm>
+#include <string.h>
+
+static bool getBit(const uint8_t *bits, uint32_t index) {
+    return (bits[index >> 3] >> (index & 7)) & 1;
+}
+
+static void setBit(uint8_t *bits, uint32_t index) {
+    bits[index >> 3] |= 1 << (index & 7);
+}
+
+static void flipBit(uint8_t *bits, uint32_t index) {
+    bits[index >> 3] ^= 1 << (index & 7);
+}
+
+static void xorBytes(uint8_t *data, const uint8_t *other, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        data[i] ^= other[i];
+    }
+}
+
+// Generator of the parity matrix, as specified by TS004
+static int32_t prbs23(int32_t x) {
+    int32_t b0 = x & 1;
+    int32_t b1 = (x & 0x20) >> 5;
+    return (x >> 1) + ((b0 ^ b1) << 22);
+}
+
+void SimpleTTNFragmentDecoder::parityLine(uint16_t n, uint16_t fragments, uint8_t *line) {
+    memset(line, 0, (fragments + 7) / 8);
+    // The modulus is one higher for powers of two, like in the reference encoder
+    int32_t modulus = (fragments & (fragments - 1)) == 0 ? fragments + 1 : fragments;
+    int32_t x = 1 + 1001 * (int32_t)n;
+    for (uint16_t coefficients = 0; coefficients < fragments / 2; coefficients++) {
+        int32_t r = 1 << 16;
+        while (r >= fragments) {
+            x = prbs23(x);
+            r = x % modulus;
+        }
+        setBit(line, r);
+    }
+}
+
+uint32_t SimpleTTNFragmentDecoder::storageSize(uint16_t fragments, uint8_t fragmentSize, uint16_t maxLost) {
+    return (uint32_t)(fragments + std::min(fragments, maxLost)) * fragmentSize;
+}
+
+bool SimpleTTNFragmentDecoder::begin(uint16_t fragments, uint8_t fragmentSize, uint16_t maxLost,
+                                     const SimpleTTNFragmentStorage &storage) {
+    end();
+    if (fragments == 0 || fragmentSize == 0 || storage.write == nullptr || storage.read == nullptr) {
+        return false;
+    }
+    if (storage.erase && !storage.erase(storage.context, storageSize(fragments, fragmentSize, maxLost))) {
+        return false;
+    }
+
+    _storage = storage;
+    _maxLost = std::min(fragments, maxLost);
+    _status.fragments = fragments;
+    _status.fragmentSize = fragmentSize;
+
+    _received.assign((fragments + 7) / 8, 0);
+    _lost.reserve(_maxLost);
+    _matrix.assign(((uint32_t)_maxLost * (_maxLost + 1) / 2 + 7) / 8, 0);
+    _pivots.assign((_maxLost + 7) / 8, 0);
+    _line.assign((fragments + 7) / 8, 0);
+    _row.assign((_maxLost + 7) / 8, 0);
+    _data.assign(fragmentSize, 0);
+    _buffer.assign(fragmentSize, 0);
+    return true;
+}
+
+void SimpleTTNFragmentDecoder::end() {
+    _status = SimpleTTNFragmentStatus();
+    _maxLost = 0;
+    // Release the memory, clear() keeps it
+    std::vector<uint8_t>().swap(_received);
+    std::vector<uint16_t>().swap(_lost);
+    std::vector<uint8_t>().swap(_matrix);
+    std::vector<uint8_t>().swap(_pivots);
+    std::vector<uint8_t>().swap(_line);
+    std::vector<uint8_t>().swap(_row);
+    std::vector<uint8_t>().swap(_data);
+    std::vector<uint8_t>().swap(_buffer);
+}
+
+size_t SimpleTTNFragmentDecoder::memoryUsage() const {
+    return _received.capacity() + _lost.capacity() * sizeof(uint16_t) + _matrix.capacity() +
+        _pivots.capacity() + _line.capacity() + _row.capacity() + _data.capacity() + _buffer.capacity();
+}
+
+SimpleTTNFragmentResult SimpleTTNFragmentDecoder::process(uint16_t index, const uint8_t *data, size_t length) {
+    const uint16_t fragments = _status.fragments;
+    if (fragments == 0 || _status.memoryError || _status.storageError) {
+        return SimpleTTNFragmentFailed;
+    }
+    if (_status.complete) {
+        return SimpleTTNFragmentComplete;
+    }
+    if (index == 0 || length != _status.fragmentSize) {
+        return SimpleTTNFragmentOngoing;
+    }
+    const bool parityStarted = _status.lastIndex > fragments;
+    _status.lastIndex = std::max(_status.lastIndex, index);
+
+    if (index <= fragments) {
+        // Lost fragments are fixed once parity fragments are being combined
+        if (parityStarted || getBit(_received.data(), index - 1)) {
+            return SimpleTTNFragmentOngoing;
+        }
+        if (!writeFragment(index - 1, data)) {
+            return SimpleTTNFragmentFailed;
+        }
+        setBit(_received.data(), index - 1);
+        _status.uncoded += 1;
+        _status.complete = _status.uncoded == fragments;
+        return _status.complete ? SimpleTTNFragmentComplete : SimpleTTNFragmentOngoing;
+    }
+
+    _status.parity += 1;
+    if (!parityStarted) {
+        startParity();
+        if (_status.memoryError) {
+            return SimpleTTNFragmentFailed;
+        }
+    }
+
+    // Remove the fragments that were received from the parity fragment, which
+    // leaves a combination of lost fragments only
+    const uint16_t lost = _status.lost;
+    memcpy(_data.data(), data, length);
+    std::fill(_row.begin(), _row.end(), 0);
+    bool useful = false;
+    parityLine(index - fragments, fragments, _line.data());
+    for (uint16_t i = 0; i < fragments; i++) {
+        if (!getBit(_line.data(), i)) {
+            continue;
+        }
+        if (getBit(_received.data(), i)) {
+            if (!readFragment(i, _buffer.data())) {
+                return SimpleTTNFragmentFailed;
+            }
+            xorBytes(_data.data(), _buffer.data(), length);
+        } else {
+            setBit(_row.data(), lostIndex(i));
+            useful = true;
+        }
+    }
+    if (!useful) {
+        return SimpleTTNFragmentOngoing;
+    }
+
+    // Reduce by the rows already collected until the leading column is new
+    uint16_t pivot = 0;
+    while (true) {
+        while (pivot < lost && !getBit(_row.data(), pivot)) {
+            pivot++;
+        }
+        if (pivot == lost) {
+            // Nothing new in this one
+            return SimpleTTNFragmentOngoing;
+        }
+        if (!getBit(_pivots.data(), pivot)) {
+            break;
+        }
+        for (uint16_t column = pivot; column < lost; column++) {
+            if (getBit(_matrix.data(), matrixBit(pivot, column))) {
+                flipBit(_row.data(), column);
+            }
+        }
+        if (!readFragment(fragments + pivot, _buffer.data())) {
+            return SimpleTTNFragmentFailed;
+        }
+        xorBytes(_data.data(), _buffer.data(), length);
+    }
+
+    for (uint16_t column = pivot; column < lost; column++) {
+        if (getBit(_row.data(), column)) {
+            setBit(_matrix.data(), matrixBit(pivot, column));
+        }
+    }
+    if (!writeFragment(fragments + pivot, _data.data())) {
+        return SimpleTTNFragmentFailed;
+    }
+    setBit(_pivots.data(), pivot);
+    _status.recovered += 1;
+
+    if (_status.recovered < lost) {
+        return SimpleTTNFragmentOngoing;
+    }
+    if (!solve()) {
+        return SimpleTTNFragmentFailed;
+    }
+    _status.complete = true;
+    return SimpleTTNFragmentComplete;
+}
+
+void SimpleTTNFragmentDecoder::startParity() {
+    for (uint16_t i = 0; i < _status.fragments; i++) {
+        if (!getBit(_received.data(), i)) {
+            if (_lost.size() == _maxLost) {
+                _status.memoryError = true;
+                return;
+            }
+            _lost.push_back(i);
+        }
+    }
+    _status.lost = _lost.size();
+}
+
+// The matrix is upper triangular with ones on the diagonal, so the lost
+// fragments are solved from the last one up. Each one is written to its
+// place in the block once, with the ones after it already final.
+bool SimpleTTNFragmentDecoder::solve() {
+    const uint16_t fragments = _status.fragments;
+    const uint8_t fragmentSize = _status.fragmentSize;
+    for (int32_t row = (int32_t)_status.lost - 1; row >= 0; row--) {
+        if (!readFragment(fragments + row, _data.data())) {
+            return false;
+        }
+        for (uint16_t column = row + 1; column < _status.lost; column++) {
+            if (getBit(_matrix.data(), matrixBit(row, column))) {
+                if (!readFragment(_lost[column], _buffer.data())) {
+                    return false;
+                }
+                xorBytes(_data.data(), _buffer.data(), fragmentSize);
+            }
+        }
+        if (!writeFragment(_lost[row], _data.data())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SimpleTTNFragmentDecoder::readFragment(uint32_t slot, uint8_t *data) {
+    uint8_t fragmentSize = _status.fragmentSize;
+    if (!_storage.read(_storage.context, slot * fragmentSize, data, fragmentSize)) {
+        _status.storageError = true;
+        return false;
+    }
+    return true;
+}
+
+bool SimpleTTNFragmentDecoder::writeFragment(uint32_t slot, const uint8_t *data) {
+    uint8_t fragmentSize = _status.fragmentSize;
+    if (!_storage.write(_storage.context, slot * fragmentSize, data, fragmentSize)) {
+        _status.storageError = true;
+        return false;
+    }
+    return true;
+}
+
+uint16_t SimpleTTNFragmentDecoder::lostIndex(uint16_t fragment) const {
+    return std::lower_bound(_lost.begin(), _lost.end(), fragment) - _lost.begin();
+}
+
+uint32_t SimpleTTNFragmentDecoder::matrixBit(uint16_t row, uint16_t column) const {
+    // Rows before this one hold _maxLost, _maxLost - 1, ... columns
+    return (uint32_t)row * _maxLost - (uint32_t)row * (row - 1) / 2 + (column - row);
+}
@@ -0,0 +1,141 @@
+#ifndef SimpleTTNFragmentDecoder_h
+#define SimpleTTNFragmentDecoder_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Storage for a block received in fragments, typically a flash partition.
+// Offsets are below SimpleTTNFragmentDecoder::storageSize(): the block itself
+// comes first, followed by scratch space for parity fragments while lost
+// fragments are being recovered. Each byte is written at most once per
+// session, so erased flash can be written directly.
+struct SimpleTTNFragmentStorage {
+    // Prepares size bytes for a new session, e.g. erases the flash. Optional.
+    bool (*erase)(void *context, uint32_t size) = nullptr;
+    bool (*write)(void *context, uint32_t offset, const uint8_t *data, size_t length) = nullptr;
+    bool (*read)(void *context, uint32_t offset, uint8_t *data, size_t length) = nullptr;
+    void *context = nullptr;
+};
+
+enum SimpleTTNFragmentResult {
+    SimpleTTNFragmentOngoing,
+    SimpleTTNFragmentComplete,
+    // More fragments were lost than can be recovered, or storage failed
+    SimpleTTNFragmentFailed
+};
+
+// Progress of a fragmented block.
+struct SimpleTTNFragmentStatus {
+    // Uncoded fragments in the block, 0 without a session
+    uint16_t fragments = 0;
+    uint8_t fragmentSize = 0;
+    uint16_t uncoded = 0;
+    uint16_t parity = 0;
+    // Uncoded fragments missing when the first parity fragment arrived
+    uint16_t lost = 0;
+    // Lost fragments that parity fragments received so far can recover
+    uint16_t recovered = 0;
+    // Highest fragment number received
+    uint16_t lastIndex = 0;
+    bool complete = false;
+    // Too many fragments lost for the memory reserved to recover them
+    bool memoryError = false;
+    bool storageError = false;
+
+    uint16_t received() const {
+        return uncoded + parity;
+    }
+
+    // Fragments that are still needed to complete the block.
+    uint16_t missing() const {
+        if (complete || fragments == 0) {
+            return 0;
+        }
+        if (lastIndex > fragments) {
+            return lost - recovered;
+        }
+        return fragments - uncoded;
+    }
+
+    // Percentage of the uncoded fragments sent so far that didn't arrive.
+    uint8_t missingPercent() const {
+        uint16_t sent = lastIndex < fragments ? lastIndex : fragments;
+        uint16_t lostSoFar = lastIndex > fragments ? lost : sent - uncoded;
+        return sent > 0 ? lostSoFar * 100 / sent : 0;
+    }
+
+    // Percentage of the block that is available or can be recovered.
+    uint8_t progress() const {
+        if (complete) {
+            return 100;
+        }
+        return fragments > 0 ? (uncoded + recovered) * 100 / fragments : 0;
+    }
+};
+
+// Reassembles a block sent with the fragmented data block transport
+// (LoRaWAN TS004): fragments 1 to M carry the block, the ones after that are
+// parity fragments, each the XOR of a pseudo-random half of the block. Lost
+// fragments are recovered by Gaussian elimination over GF(2) as parity
+// fragments arrive, so the block is complete after about M + lost fragments.
+//
+// Uncoded fragments go straight to storage. RAM holds one bit per fragment
+// and a triangular bit matrix for the lost ones, so it is bounded by
+// maxLost^2 / 16 bytes plus two fragment buffers; see memoryUsage().
+class SimpleTTNFragmentDecoder {
+public:
+    // Starts a block of fragments * fragmentSize bytes, of which up to maxLost
+    // fragments can be recovered. Returns false if the storage couldn't be
+    // prepared.
+    bool begin(uint16_t fragments, uint8_t fragmentSize, uint16_t maxLost,
+               const SimpleTTNFragmentStorage &storage);
+    // Ends the session and releases its memory.
+    void end();
+
+    // Handles fragment number index (1-based, as in the DataFragment command).
+    // Uncoded fragments arriving after the first parity fragment are ignored.
+    SimpleTTNFragmentResult process(uint16_t index, const uint8_t *data, size_t length);
+
+    const SimpleTTNFragmentStatus &status() const {
+        return _status;
+    }
+    // Bytes of RAM held by the session.
+    size_t memoryUsage() const;
+
+    // Bytes of storage a session needs.
+    static uint32_t storageSize(uint16_t fragments, uint8_t fragmentSize, uint16_t maxLost);
+    // Row n (1-based) of the TS004 parity matrix for a block of the given number
+    // of fragments: bit i of line is set if fragment i + 1 is part of parity
+    // fragment fragments + n. line has (fragments + 7) / 8 bytes.
+    static void parityLine(uint16_t n, uint16_t fragments, uint8_t *line);
+
+private:
+    void startParity();
+    bool solve();
+    bool readFragment(uint32_t slot, uint8_t *data);
+    bool writeFragment(uint32_t slot, const uint8_t *data);
+    // Position of a fragment in the list of lost fragments
+    uint16_t lostIndex(uint16_t fragment) const;
+    // Bit offset of column in row of the triangular matrix
+    uint32_t matrixBit(uint16_t row, uint16_t column) const;
+
+    SimpleTTNFragmentStorage _storage;
+    SimpleTTNFragmentStatus _status;
+    uint16_t _maxLost = 0;
+
+    // One bit per uncoded fragment
+    std::vector<uint8_t> _received;
+    // Uncoded fragments (0-based) that were lost, in ascending order
+    std::vector<uint16_t> _lost;
+    // Row i holds columns i to _maxLost - 1; a row exists once its pivot bit is set
+    std::vector<uint8_t> _matrix;
+    std::vector<uint8_t> _pivots;
+    // Work buffers
+    std::vector<uint8_t> _line;
+    std::vector<uint8_t> _row;
+    std::vector<uint8_t> _data;
+    std::vector<uint8_t> _buffer;
+};
+
+#endif // SimpleTTNFragmentDecoder_h
@@ -0,0 +1,52 @@
+#ifndef SimpleTTNHex_h
+#define SimpleTTNHex_h
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+
+// Keys, EUIs and addresses are given as hex strings, most significant byte
+// first as the network console shows them. Parsing doesn't allocate, and is
+// constexpr so literals can be checked at compile time:
+//
+//   static_assert(SimpleTTNHex::isValid(APP_KEY, 16), "APP_KEY needs 32 hex digits");
+struct SimpleTTNHex {
+    // 0..15, or -1 if c isn't a hex digit
+    static constexpr int digit(char c) {
+        return c >= '0' && c <= '9' ? c - '0'
+            : c >= 'A' && c <= 'F' ? c - 'A' + 10
+            : c >= 'a' && c <= 'f' ? c - 'a' + 10
+            : -1;
+    }
+
+    // Whether hex is exactly 2 * bytes hex digits.
+    static constexpr bool isValid(const char *hex, size_t bytes) {
+        return hex != nullptr && (bytes == 0 ? *hex == '\0'
+            : digit(hex[0]) >= 0 && digit(hex[1]) >= 0 && isValid(hex + 2, bytes - 1));
+    }
+
+    // Byte i of a valid hex string.
+    static constexpr uint8_t byte(const char *hex, size_t i) {
+        return digit(hex[2 * i]) << 4 | digit(hex[2 * i + 1]);
+    }
+
+    // Parses hex into bytes, reversed for values LMIC expects least significant
+    // byte first (the EUIs). Returns false and leaves bytes untouched if hex
+    // isn't valid.
+    template <size_t N>
+    static bool parse(const char *hex, std::array<uint8_t, N> &bytes, bool reversed = false) {
+        if (!isValid(hex, N)) {
+            return false;
+        }
+        for (size_t i = 0; i < N; i++) {
+            bytes[reversed ? N - 1 - i : i] = byte(hex, i);
+        }
+        return true;
+    }
+};
+
+static_assert(SimpleTTNHex::isValid("70B3D57ED0000000", 8), "EUI literal should be valid");
+static_assert(!SimpleTTNHex::isValid("70B3D57ED000000", 8), "short literal should be invalid");
+static_assert(SimpleTTNHex::byte("00fF", 1) == 0xFF, "hex digits are case insensitive");
+
+#endif // SimpleTTNHex_h
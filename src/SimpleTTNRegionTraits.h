@@ -0,0 +1,206 @@
+#ifndef SimpleTTNRegionTraits_h
+#define SimpleTTNRegionTraits_h
+
+#include "lmic/lmic.h"
+
+// Compile-time view of the regional parameters SimpleTTN needs. The LMIC core
+// reads the same values from flash tables through the LMICbandplan_* macros;
+// here they are constexpr, so for the configured region the compiler folds
+// them into the callers. Values mirror the tables in lmic_<region>.c and
+// have to be kept in sync with them.
+//
+// Everything only depends on lorabase.h, so the traits of any region can be
+// used (and checked with static_assert) regardless of the configured one.
+
+// Timing of a single frame, following calcAirTime() in lmic.c. Times are in
+// microseconds so they don't depend on OSTICKS_PER_SEC.
+struct SimpleTTNRadioTiming {
+    // 7..12, or 0 for FSK
+    static constexpr uint8_t spreadingFactor(rps_t rps) {
+        return (rps & 0x7) == FSK ? 0 : (rps & 0x7) + (7 - SF7);
+    }
+
+    // 0, 1, 2 for 125, 250 and 500 kHz
+    static constexpr uint8_t bandwidth(rps_t rps) {
+        return (rps >> 3) & 0x3;
+    }
+
+    // Matches the FSK half symbol time of 80 us used for the receive windows.
+    static constexpr uint32_t symbolTime(rps_t rps) {
+        return spreadingFactor(rps) == 0 ? 160 : (8ul << spreadingFactor(rps)) >> bandwidth(rps);
+    }
+
+    static constexpr uint32_t airtime(rps_t rps, uint8_t length) {
+        return spreadingFactor(rps) == 0
+            // preamble, sync word, length and CRC at 50 kbit/s
+            ? (length + 5 + 3 + 1 + 2) * 160ul
+            // One quarter symbol at 125 kHz lasts 2 us << (sf - 7)
+            : ((uint32_t)quarterSymbols(rps, length) << (spreadingFactor(rps) + 1)) >> bandwidth(rps);
+    }
+
+private:
+    static constexpr int payloadBits(rps_t rps, uint8_t length) {
+        return 8 * length - 4 * spreadingFactor(rps) + 28 +
+            (((rps >> 7) & 0x1) ? 0 : 16) - ((rps >> 8) ? 20 : 0);
+    }
+
+    // Low data rate optimization is enabled from SF11 on, as in calcAirTime().
+    static constexpr int bitsPerSymbol(rps_t rps) {
+        return 4 * spreadingFactor(rps) - (spreadingFactor(rps) >= 11 ? 8 : 0);
+    }
+
+    static constexpr int payloadSymbols(rps_t rps, uint8_t length) {
+        return payloadBits(rps, length) > 0
+            ? 8 + (payloadBits(rps, length) + bitsPerSymbol(rps) - 1) / bitsPerSymbol(rps) * (((rps >> 5) & 0x3) + 5)
+            : 8;
+    }
+
+    // 8 preamble symbols plus 4.25 for the sync word
+    static constexpr int quarterSymbols(rps_t rps, uint8_t length) {
+        return 4 * payloadSymbols(rps, length) + 49;
+    }
+};
+
+// Values shared by every band plan, given the region's data rate table.
+template <class Region>
+struct SimpleTTNBandPlan {
+    static constexpr bool isLegal(uint8_t dr) {
+        return Region::rps(dr) != ILLEGAL_RPS;
+    }
+
+    static constexpr uint32_t symbolTime(uint8_t dr) {
+        return isLegal(dr) ? SimpleTTNRadioTiming::symbolTime(Region::rps(dr)) : 0;
+    }
+
+    // Airtime of a frame of the given PHY payload length, in microseconds.
+    static constexpr uint32_t airtime(uint8_t dr, uint8_t length) {
+        return isLegal(dr) ? SimpleTTNRadioTiming::airtime(Region::rps(dr), length) : 0;
+    }
+
+    // Application payload that fits next to the frame header, port and MIC.
+    static constexpr uint8_t maxPayloadSize(uint8_t dr, bool dwellTime = false) {
+        return Region::maxFrameLength(dr, dwellTime) > OFF_DAT_OPTS + 5
+            ? Region::maxFrameLength(dr, dwellTime) - (OFF_DAT_OPTS + 5) : 0;
+    }
+
+    // Whether TxParamSetupReq limits the uplink dwell time. Only AS923 and
+    // AU915 have such a limit; until the network sends the command, txParam
+    // is 0xFF and the region default applies.
+    static constexpr bool uplinkDwellTime(uint8_t txParam) {
+        return Region::hasDwellTimeLimit &&
+            (txParam == 0xFF || (txParam & MCMD_TxParam_TxDWELL_MASK) != 0);
+    }
+};
+
+template <int Region>
+struct SimpleTTNRegionTraits;
+
+template <>
+struct SimpleTTNRegionTraits<LMIC_REGION_eu868> : SimpleTTNBandPlan<SimpleTTNRegionTraits<LMIC_REGION_eu868> > {
+    static constexpr bool hasDwellTimeLimit = false;
+
+    static constexpr rps_t rps(uint8_t dr) {
+        return dr <= 5 ? MAKERPS(SF12 - dr, BW125, CR_4_5, 0, 0)
+            : dr == 6 ? MAKERPS(SF7, BW250, CR_4_5, 0, 0)
+            : dr == 7 ? MAKERPS(FSK, BW125, CR_4_5, 0, 0)
+            : (rps_t)ILLEGAL_RPS;
+    }
+
+    static constexpr uint8_t maxFrameLength(uint8_t dr, bool = false) {
+        return dr <= 2 ? 59 + 5 : dr == 3 ? 123 + 5 : dr <= 7 ? 250 + 5 : 0;
+    }
+};
+
+template <>
+struct SimpleTTNRegionTraits<LMIC_REGION_us915> : SimpleTTNBandPlan<SimpleTTNRegionTraits<LMIC_REGION_us915> > {
+    static constexpr bool hasDwellTimeLimit = false;
+
+    static constexpr rps_t rps(uint8_t dr) {
+        return dr <= 3 ? MAKERPS(SF10 - dr, BW125, CR_4_5, 0, 0)
+            : dr == 4 ? MAKERPS(SF8, BW500, CR_4_5, 0, 0)
+            : dr >= 8 && dr <= 13 ? MAKERPS(SF12 - (dr - 8), BW500, CR_4_5, 0, 0)
+            : (rps_t)ILLEGAL_RPS;
+    }
+
+    static constexpr uint8_t maxFrameLength(uint8_t dr, bool = false) {
+        return dr == 0 ? 19 + 5 : dr == 1 ? 61 + 5 : dr == 2 ? 133 + 5 : dr <= 4 ? 250 + 5
+            : dr == 8 ? 61 + 5 : dr == 9 ? 133 + 5 : dr >= 10 && dr <= 13 ? 250 + 5
+            : 0;
+    }
+};
+
+template <>
+struct SimpleTTNRegionTraits<LMIC_REGION_au915> : SimpleTTNBandPlan<SimpleTTNRegionTraits<LMIC_REGION_au915> > {
+    static constexpr bool hasDwellTimeLimit = true;
+
+    static constexpr rps_t rps(uint8_t dr) {
+        return dr <= 5 ? MAKERPS(SF12 - dr, BW125, CR_4_5, 0, 0)
+            : dr == 6 ? MAKERPS(SF8, BW500, CR_4_5, 0, 0)
+            : dr >= 8 && dr <= 13 ? MAKERPS(SF12 - (dr - 8), BW500, CR_4_5, 0, 0)
+            : (rps_t)ILLEGAL_RPS;
+    }
+
+    static constexpr uint8_t maxFrameLength(uint8_t dr, bool dwellTime = false) {
+        return dwellTime
+            ? (dr == 2 ? 19 + 5 : dr == 3 ? 61 + 5 : dr == 4 ? 133 + 5 : dr == 5 || dr == 6 ? 250 + 5
+                : dr == 8 ? 61 + 5 : dr == 9 ? 137 + 5 : dr >= 10 && dr <= 13 ? 250 + 5 : 0)
+            : (dr <= 2 ? 59 + 5 : dr == 3 ? 123 + 5 : dr <= 6 ? 250 + 5
+                : dr == 8 ? 61 + 5 : dr == 9 ? 137 + 5 : dr >= 10 && dr <= 13 ? 250 + 5 : 0);
+    }
+};
+
+template <>
+struct SimpleTTNRegionTraits<LMIC_REGION_as923> : SimpleTTNBandPlan<SimpleTTNRegionTraits<LMIC_REGION_as923> > {
+    static constexpr bool hasDwellTimeLimit = true;
+
+    static constexpr rps_t rps(uint8_t dr) {
+        return SimpleTTNRegionTraits<LMIC_REGION_eu868>::rps(dr);
+    }
+
+    static constexpr uint8_t maxFrameLength(uint8_t dr, bool dwellTime = false) {
+        return dwellTime
+            ? (dr == 2 ? 19 + 5 : dr == 3 ? 61 + 5 : dr == 4 ? 133 + 5 : dr >= 5 && dr <= 7 ? 250 + 5 : 0)
+            : SimpleTTNRegionTraits<LMIC_REGION_eu868>::maxFrameLength(dr);
+    }
+};
+
+template <>
+struct SimpleTTNRegionTraits<LMIC_REGION_kr920> : SimpleTTNBandPlan<SimpleTTNRegionTraits<LMIC_REGION_kr920> > {
+    static constexpr bool hasDwellTimeLimit = false;
+
+    static constexpr rps_t rps(uint8_t dr) {
+        return dr <= 5 ? MAKERPS(SF12 - dr, BW125, CR_4_5, 0, 0) : (rps_t)ILLEGAL_RPS;
+    }
+
+    static constexpr uint8_t maxFrameLength(uint8_t dr, bool = false) {
+        return dr <= 2 ? 59 + 5 : dr == 3 ? 123 + 5 : dr <= 5 ? 250 + 5 : 0;
+    }
+};
+
+template <>
+struct SimpleTTNRegionTraits<LMIC_REGION_in866> : SimpleTTNBandPlan<SimpleTTNRegionTraits<LMIC_REGION_in866> > {
+    static constexpr bool hasDwellTimeLimit = false;
+
+    static constexpr rps_t rps(uint8_t dr) {
+        return dr <= 5 ? MAKERPS(SF12 - dr, BW125, CR_4_5, 0, 0)
+            : dr == 7 ? MAKERPS(FSK, BW125, CR_4_5, 0, 0)
+            : (rps_t)ILLEGAL_RPS;
+    }
+
+    static constexpr uint8_t maxFrameLength(uint8_t dr, bool = false) {
+        return dr <= 2 ? 59 + 5 : dr == 3 ? 123 + 5 : dr <= 5 || dr == 7 ? 250 + 5 : 0;
+    }
+};
+
+// The region selected in lmic_project_config.h
+typedef SimpleTTNRegionTraits<CFG_region> SimpleTTNConfiguredRegion;
+
+// Reference values from the LoRa airtime formula (Semtech AN1200.13)
+static_assert(SimpleTTNRadioTiming::airtime(MAKERPS(SF7, BW125, CR_4_5, 0, 0), 13) == 46336,
+    "SF7 airtime doesn't match calcAirTime()");
+static_assert(SimpleTTNRadioTiming::airtime(MAKERPS(SF12, BW125, CR_4_5, 0, 0), 13) == 1155072,
+    "SF12 airtime doesn't match calcAirTime()");
+static_assert(SimpleTTNConfiguredRegion::isLegal(LMICbandplan_getInitialDrJoin()),
+    "Join data rate is not in the region traits");
+
+#endif
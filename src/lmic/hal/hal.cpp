@@ -12,6 +12,9 @@
 
 #include <Arduino.h>
 #include <SPI.h>
+#if defined(ARDUINO_ARCH_ESP32)
+# include <esp_timer.h>
+#endif
 // include all the lmic header files, including ../lmic/hal.h
 #include "../lmic.h"
 // include the C++ hal.h
@@ -105,21 +108,40 @@ static void hal_io_check() {
     }
 }
 
+void hal_setIrqNotify (hal_irq_notify_t *notify, void *context) {
+    // DIO lines are polled, there are no interrupts to notify about
+}
+
 #else
 // Interrupt handlers
-static ostime_t interrupt_time[NUM_DIO] = {0};
+static ostime_t volatile interrupt_time[NUM_DIO] = {0};
+static hal_irq_notify_t *volatile irq_notify = NULL;
+static void *volatile irq_notify_context = NULL;
 
-static void hal_isrPin0() {
+// Timestamp the edge; the radio is serviced by hal_processPendingIRQs()
+static void IRAM_ATTR hal_isrPin(uint8_t dio) {
     ostime_t now = os_getTime();
-    interrupt_time[0] = now ? now : 1;
+    interrupt_time[dio] = now ? now : 1;
+    hal_irq_notify_t *notify = irq_notify;
+    if (notify != NULL)
+        notify(irq_notify_context);
 }
-static void hal_isrPin1() {
-    ostime_t now = os_getTime();
-    interrupt_time[1] = now ? now : 1;
+
+static void IRAM_ATTR hal_isrPin0() {
+    hal_isrPin(0);
 }
-static void hal_isrPin2() {
-    ostime_t now = os_getTime();
-    interrupt_time[2] = now ? now : 1;
+static void IRAM_ATTR hal_isrPin1() {
+    hal_isrPin(1);
+}
+static void IRAM_ATTR hal_isrPin2() {
+    hal_isrPin(2);
+}
+
+void hal_setIrqNotify (hal_irq_notify_t *notify, void *context) {
+    noInterrupts();
+    irq_notify = notify;
+    irq_notify_context = context;
+    interrupts();
 }
 
 typedef void (*isr_t)();
@@ -142,11 +164,12 @@ static void hal_io_check() {
         if (plmic_pins->dio[i] == LMIC_UNUSED_PIN)
             continue;
 
+        noInterrupts();
         iTime = interrupt_time[i];
-        if (iTime) {
-            interrupt_time[i] = 0;
+        interrupt_time[i] = 0;
+        interrupts();
+        if (iTime)
             radio_irq_handler_v2(i, iTime);
-        }
     }
 }
 #endif // LMIC_USE_INTERRUPTS
@@ -197,6 +220,17 @@ static void hal_time_init () {
     // Nothing to do
 }
 
+#if defined(ARDUINO_ARCH_ESP32)
+// esp_timer counts microseconds from boot in 64 bits, so there is nothing to
+// track between calls, and it can be read from interrupt handlers.
+uint64_t hal_ticks64 () {
+    return (uint64_t)esp_timer_get_time() >> US_PER_OSTICK_EXPONENT;
+}
+
+u4_t hal_ticks () {
+    return (u4_t)hal_ticks64();
+}
+#else
 u4_t hal_ticks () {
     // Because micros() is scaled down in this function, micros() will
     // overflow before the tick timer should, causing the tick timer to
@@ -242,6 +276,20 @@ u4_t hal_ticks () {
     static_assert(US_PER_OSTICK_EXPONENT > 0 && US_PER_OSTICK_EXPONENT < 8, "Invalid US_PER_OSTICK_EXPONENT value");
 }
 
+// Extends hal_ticks() by counting its wraps, which needs a call at least
+// once per wrap (about 19 hours at 16 us per tick).
+uint64_t hal_ticks64 () {
+    static u4_t last = 0;
+    static u4_t wraps = 0;
+
+    u4_t const now = hal_ticks();
+    if (now < last)
+        wraps++;
+    last = now;
+    return ((uint64_t)wraps << 32) | now;
+}
+#endif // ARDUINO_ARCH_ESP32
+
 // Returns the number of ticks until time. Negative values indicate that
 // time has already passed.
 static s4_t delta_time(u4_t time) {
@@ -319,18 +367,21 @@ void hal_enableIRQs () {
     if(--irqlevel == 0) {
         interrupts();
 
-        // Instead of using proper interrupts (which are a bit tricky
-        // and/or not available on all pins on AVR), just poll the pin
-        // values. Since os_runloop disables and re-enables interrupts,
-        // putting this here makes sure we check at least once every
-        // loop.
-        //
-        // As an additional bonus, this prevents the can of worms that
-        // we would otherwise get for running SPI transfers inside ISRs
+#if !defined(LMIC_USE_INTERRUPTS)
+        // Instead of using proper interrupts, just poll the pin values,
+        // as often as possible. With interrupts, edges are timestamped by
+        // the ISRs and handled by hal_processPendingIRQs() instead, which
+        // saves reading the pins on every call and keeps SPI transfers
+        // out of whatever task happens to re-enable interrupts.
         hal_io_check();
+#endif
     }
 }
 
+void hal_processPendingIRQs () {
+    hal_io_check();
+}
+
 uint8_t hal_getIrqLevel(void) {
     return irqlevel;
 }
@@ -212,4 +212,38 @@
 # define LMIC_ENABLE_arbitrary_clock_error 0	/* PARAM */
 #endif
 
+// LMIC_ENABLE_channel_stats
+// Keep per-channel counts of uplinks, acknowledgements, downlinks and LBT
+// busy results, and allow channel selection to be weighted by them (see
+// LMIC_setAdaptiveChannels()). The statistics take 10 bytes per channel, 720
+// bytes in US-like regions. This is always defined, and non-zero to enable.
+#if !defined(LMIC_ENABLE_channel_stats)
+# define LMIC_ENABLE_channel_stats 0        /* PARAM */
+#endif
+
+// LMIC_ENABLE_class_c
+// Allow the device to listen continuously on the RX2 frequency and data rate
+// while no transaction is in progress (LoRaWAN Class C, see LMIC_setClassC()).
+// This is always defined, and non-zero to enable.
+#if !defined(LMIC_ENABLE_class_c)
+# define LMIC_ENABLE_class_c 1              /* PARAM */
+#endif
+
+// LMIC_ENABLE_lbt_cad
+// Allow listen-before-talk on LoRa channels to use the radio's channel
+// activity detection instead of sampling the RSSI (see LMIC_setLbtCad()).
+// This is always defined, and non-zero to enable.
+#if !defined(LMIC_ENABLE_lbt_cad)
+# define LMIC_ENABLE_lbt_cad 1              /* PARAM */
+#endif
+
+// LMIC_MULTICAST_GROUPS
+// Number of multicast sessions (McAddr, McNwkSKey, McAppSKey, McFCntDown)
+// the device can be a member of, see LMIC_setMulticastSession(). Multicast
+// frames are only received in Class B ping slots and in Class C, so multicast
+// is disabled (0) by default. Each group takes 40 bytes of lmic_t.
+#if !defined(LMIC_MULTICAST_GROUPS)
+# define LMIC_MULTICAST_GROUPS 0            /* PARAM */
+#endif
+
 #endif // _lmic_config_h_
@@ -44,6 +44,9 @@ extern "C"{
 // The type of an optional user-defined failure handler routine
 typedef void LMIC_ABI_STD hal_failure_handler_t(const char* const file, const uint16_t line);
 
+// The type of an optional routine called from the DIO interrupt handler
+typedef void LMIC_ABI_STD hal_irq_notify_t(void *context);
+
 /*
  * initialize hardware (IO, SPI, TIMER, IRQ).
  * This API is deprecated as it uses the const global lmic_pins,
@@ -94,6 +97,20 @@ void hal_disableIRQs (void);
  */
 void hal_enableIRQs (void);
 
+/*
+ * run the radio IRQ handler for DIO edges seen since the last call.
+ * Called by os_runloop_once(), so the radio is only serviced by the task
+ * that runs the LMIC.
+ */
+void hal_processPendingIRQs (void);
+
+/*
+ * set a routine called from the DIO interrupt handler after an edge was
+ * recorded, e.g. to wake the task that runs the LMIC. It runs in interrupt
+ * context. Only used with LMIC_USE_INTERRUPTS.
+ */
+void hal_setIrqNotify (hal_irq_notify_t *notify, void *context);
+
 /*
  * return CPU interrupt nesting count
  */
@@ -109,6 +126,11 @@ void hal_sleep (void);
  */
 u4_t hal_ticks (void);
 
+/*
+ * return 64-bit system time in ticks. The lower 32 bits are hal_ticks().
+ */
+uint64_t hal_ticks64 (void);
+
 /*
  * busy-wait until specified timestamp (in ticks) is reached. If on-time, return 0,
  * otherwise return the number of ticks we were late.
@@ -391,8 +391,9 @@ ostime_t LMICcore_rndDelay (u1_t secSpan) {
 static void txDelay (ostime_t reftime, u1_t secSpan) {
     if (secSpan != 0)
         reftime += LMICcore_rndDelay(secSpan);
-    if( LMIC.globalDutyRate == 0  ||  (reftime - LMIC.globalDutyAvail) > 0 ) {
-        LMIC.globalDutyAvail = reftime;
+    ostime64_t const reftime64 = os_extendTime(reftime);
+    if( LMIC.globalDutyRate == 0  ||  reftime64 > LMIC.globalDutyAvail ) {
+        LMIC.globalDutyAvail = reftime64;
         LMIC.opmode |= OP_RNDTX;
     }
 }
@@ -441,6 +442,7 @@ static bit_t setDrTxpow (u1_t reason, u1_t dr, s1_t pow) {
 #if !defined(DISABLE_PING)
 void LMIC_stopPingable (void) {
     LMIC.opmode &= ~(OP_PINGABLE|OP_PINGINI);
+    LMIC.pingSlotInfoReq = 0;
 }
 
 
@@ -448,6 +450,8 @@ void LMIC_setPingable (u1_t intvExp) {
     // Change setting
     LMIC.ping.intvExp = (intvExp & 0x7);
     LMIC.opmode |= OP_PINGABLE;
+    // Tell the network about the periodicity with the next uplinks
+    LMIC.pingSlotInfoReq = 1;
     // App may call LMIC_enableTracking() explicitely before
     // Otherwise tracking is implicitly enabled here
     if( (LMIC.opmode & (OP_TRACK|OP_SCAN)) == 0  &&  LMIC.bcninfoTries == 0 )
@@ -979,7 +983,7 @@ scan_mac_cmds(
         case MCMD_DutyCycleReq: {
             u1_t cap = opts[oidx+1];
             LMIC.globalDutyRate  = cap & 0xF;
-            LMIC.globalDutyAvail = os_getTime();
+            LMIC.globalDutyAvail = os_getTime64();
             DO_DEVDB(cap,dutyCap);
 
             response_fit = put_mac_uplink_byte(MCMD_DutyCycleAns);
@@ -1113,6 +1117,13 @@ scan_mac_cmds(
         } /* end case */
 #endif // LMIC_ENABLE_TxParamSetupReq
 
+#if !defined(DISABLE_PING)
+        case MCMD_PingSlotInfoAns: {
+            LMIC.pingSlotInfoReq = 0;
+            break;
+        } /* end case */
+#endif // !DISABLE_PING
+
 #if LMIC_ENABLE_DeviceTimeReq
         case MCMD_DeviceTimeAns: {
             // don't process a spurious downlink.
@@ -1170,11 +1181,84 @@ static void setAdrAckCount (s2_t count) {
     }
 }
 
+#if LMIC_MULTICAST_GROUPS > 0
+static u1_t findMulticastGroup (devaddr_t addr) {
+    if( addr == 0 )
+        return LMIC_MULTICAST_NONE;
+    for( u1_t group = 0; group < LMIC_MULTICAST_GROUPS; group++ ) {
+        if( LMIC.multicast[group].addr == addr )
+            return group;
+    }
+    return LMIC_MULTICAST_NONE;
+}
+
+// Decodes a frame addressed to one of the multicast groups. The group is
+// found by address before any crypto, so only its own keys are tried. Only
+// unconfirmed data frames on an application port are accepted, and nothing
+// of the unicast session (counters, ACK and MAC state) is touched.
+static bit_t decodeMulticastFrame (u1_t group) {
+    lmic_multicast_session_t * const pSession = &LMIC.multicast[group];
+    xref2u1_t d = LMIC.frame;
+    int  dlen  = LMIC.dataLen;
+    int  fct   = d[OFF_DAT_FCT];
+    u4_t seqno = os_rlsbf2(&d[OFF_DAT_SEQNO]);
+    int  poff  = OFF_DAT_OPTS;
+    int  pend  = dlen-4;  // MIC
+
+    // multicast is sent in ping slots and Class C, never as the answer
+    // to an uplink.
+    if( (LMIC.opmode & OP_TXRXPEND) != 0 ||
+        (d[0] & HDR_FTYPE) != HDR_FTYPE_DADN ||
+        (fct & (FCT_ACK|FCT_OPTLEN)) != 0 ||
+        pend <= poff || d[poff] == 0 ) {
+        LMICOS_logEventUint32("decodeMulticastFrame: not allowed", ((u4_t)group << 16) | (d[0] << 8) | fct);
+        goto norx;
+    }
+    int port = d[poff++];
+
+    // reject replays: anything before the next expected counter looks like
+    // a huge gap.
+    u2_t seqnoDiff = (u2_t)(seqno - pSession->seqnoDn);
+    if( seqnoDiff > LMICbandplan_MAX_FCNT_GAP ) {
+        LMICOS_logEventUint32("decodeMulticastFrame: bad seqno", ((u4_t)group << 16) | seqnoDiff);
+        goto norx;
+    }
+    seqno = pSession->seqnoDn + seqnoDiff;
+
+    if( !aes_verifyMic(pSession->nwkKey, pSession->addr, seqno, /*dn*/1, d, pend) ) {
+        LMICOS_logEventUint32("decodeMulticastFrame: bad MIC", ((u4_t)group << 16) | (seqno & 0xFFFF));
+        goto norx;
+    }
+    aes_cipher(pSession->artKey, pSession->addr, seqno, /*dn*/1, d+poff, pend-poff);
+    pSession->seqnoDn = seqno+1;
+
+#if LMIC_DEBUG_LEVEL > 0
+    LMIC_DEBUG_PRINTF("%"LMIC_PRId_ostime_t": Received multicast, group=%u, port=%d, seqno=%"PRIu32"\n",
+                      os_getTime(), group, port, seqno);
+#else
+    LMIC_API_PARAMETER(port);
+#endif
+
+    orTxrxFlags(__func__, TXRX_PORT);
+    LMIC.dataGroup = group;
+    LMIC.dataBeg = poff;
+    LMIC.dataLen = pend-poff;
+    return 1;
+
+  norx:
+    LMIC.dataLen = 0;
+    return 0;
+}
+#endif // LMIC_MULTICAST_GROUPS > 0
+
 static bit_t decodeFrame (void) {
     xref2u1_t d = LMIC.frame;
     u1_t hdr    = d[0];
     u1_t ftype  = hdr & HDR_FTYPE;
     int  dlen   = LMIC.dataLen;
+#if LMIC_MULTICAST_GROUPS > 0
+    LMIC.dataGroup = LMIC_MULTICAST_NONE;
+#endif
 #if LMIC_DEBUG_LEVEL > 0
     const char *window = (LMIC.txrxFlags & TXRX_DNW1) ? "RX1" : ((LMIC.txrxFlags & TXRX_DNW2) ? "RX2" : "Other");
 #endif
@@ -1207,6 +1291,11 @@ static bit_t decodeFrame (void) {
     int  pend  = dlen-4;  // MIC
 
     if( addr != LMIC.devaddr ) {
+#if LMIC_MULTICAST_GROUPS > 0
+        u1_t const group = findMulticastGroup(addr);
+        if( group != LMIC_MULTICAST_NONE )
+            return decodeMulticastFrame(group);
+#endif
         LMICOS_logEventUint32("decodeFrame: wrong address", addr);
 
         EV(specCond, WARN, (e_.reason = EV::specCond_t::ALIEN_ADDRESS,
@@ -1902,6 +1991,18 @@ static bit_t buildDataFrame (void) {
         LMIC.txDeviceTimeReqState = lmic_RequestTimeState_rx;
     }
 #endif // LMIC_ENABLE_DeviceTimeReq
+#if !defined(DISABLE_PING)
+    if ( LMIC.pingSlotInfoReq ) {
+        LMIC.frame[end+0] = MCMD_PingSlotInfoReq;
+#if LMIC_LORAWAN_SPEC_VERSION < LMIC_LORAWAN_SPEC_VERSION_1_0_3
+        LMIC.frame[end+1] = (LMIC.ping.intvExp << 4) | (LMIC.ping.dr & 0xF);
+#else
+        // 1.0.3 Class B: only the periodicity, the data rate is set by the network
+        LMIC.frame[end+1] = LMIC.ping.intvExp & 0x7;
+#endif
+        end += 2;
+    }
+#endif // !DISABLE_PING
 #if !defined(DISABLE_BEACONS) && defined(ENABLE_MCMD_BeaconTimingAns)
     if ( LMIC.bcninfoTries > 0 ) {
         LMIC.frame[end+0] = MCMD_BeaconInfoReq;
@@ -1939,6 +2040,10 @@ static bit_t buildDataFrame (void) {
     LMIC.frame[OFF_DAT_HDR] = HDR_FTYPE_DAUP | HDR_MAJOR_V1;
     LMIC.frame[OFF_DAT_FCT] = (LMIC.dnConf | LMIC.adrEnabled
                               | (sendAdrAckReq() ? FCT_ADRACKReq : 0)
+#if !defined(DISABLE_PING)
+                              // we are listening in ping slots
+                              | ((LMIC.opmode & (OP_TRACK|OP_PINGABLE)) == (OP_TRACK|OP_PINGABLE) ? FCT_CLASSB : 0)
+#endif
                               | (end-OFF_DAT_OPTS));
     os_wlsbf4(LMIC.frame+OFF_DAT_ADDR,  LMIC.devaddr);
 
@@ -2204,6 +2309,57 @@ static void processPingRx (xref2osjob_t osjob) {
 }
 #endif // !DISABLE_PING
 
+
+#if LMIC_ENABLE_class_c
+// Class C: between transactions, the radio listens on the RX2 frequency and
+// data rate. Listening stops whenever the engine runs, and is restarted by
+// engineUpdate_inner() if the device is still idle afterwards.
+
+static void processClassCRx(xref2osjob_t osjob);
+
+// whether the device may listen now. The radio driver has no continuous
+// FSK receive, so an FSK RX2 data rate rules it out.
+static bit_t classCAllowed(void) {
+    return LMIC.client.classC &&
+           LMIC.devaddr != 0 &&
+           getSf(dndr2rps(LMIC.dn2Dr)) != FSK &&
+           LMIC.txCnt == 0 &&
+           (LMIC.opmode & (OP_SCAN|OP_TRACK|OP_JOINING|OP_REJOIN|OP_SHUTDOWN|OP_TESTMODE|OP_TXRXPEND)) == 0;
+}
+
+// start listening. The receive job runs when a frame arrives or, for a
+// non-zero deadline, when the deadline is reached.
+static void startClassCRx(ostime_t deadline) {
+    initTxrxFlags(__func__, TXRX_DNW2);
+    LMIC.rps = dndr2rps(LMIC.dn2Dr);
+    LMIC.freq = LMIC.dn2Freq;
+    LMIC.dataLen = 0;
+    LMIC.opmode |= OP_CLASSC;
+    if (deadline != 0)
+        os_setTimedCallback(&LMIC.osjob, deadline, FUNC_ADDR(processClassCRx));
+    else
+        LMIC.osjob.func = FUNC_ADDR(processClassCRx);
+    os_radio(RADIO_RXON);
+}
+
+// stop listening, and deliver a frame that arrived before its job ran.
+static void stopClassCRx(void) {
+    os_radio(RADIO_RST);
+    LMIC.opmode &= ~OP_CLASSC;
+    if( LMIC.dataLen != 0 && decodeFrame() ) {
+        reportEventNoUpdate(EV_RXCOMPLETE);
+    }
+}
+
+static void processClassCRx (xref2osjob_t osjob) {
+    LMIC_API_PARAMETER(osjob);
+
+    stopClassCRx();
+    // listen again, or send the uplink we were waiting for
+    engineUpdate();
+}
+#endif // LMIC_ENABLE_class_c
+
 // process downlink data at close of RX window.  Return zero if another RX window
 // should be scheduled, non-zero to prevent scheduling of RX2 (if relevant).
 // Confusingly, the caller actualyl does some of the calculation, so the answer from
@@ -2220,6 +2376,10 @@ static void processPingRx (xref2osjob_t osjob) {
 // forward references.
 static bit_t processDnData_norx(void);
 static bit_t processDnData_txcomplete(void);
+#if LMIC_ENABLE_channel_stats
+static void channelStatsUplink(void);
+static void channelStatsDownlink(void);
+#endif
 
 static bit_t processDnData (void) {
     // if no TXRXPEND, we shouldn't be here and can do nothign.
@@ -2246,6 +2406,11 @@ static bit_t processDnData (void) {
             // to close the books on this uplink attempt
             return processDnData_norx();
     }
+
+#if LMIC_ENABLE_channel_stats
+    channelStatsDownlink();
+#endif
+
     // downlink frame was accepted. This means that we're done. Except
     // there's one bizarre corner case. If we sent a confirmed message
     // and got a downlink that didn't have an ACK, we have to retry.
@@ -2254,7 +2419,7 @@ static bit_t processDnData (void) {
     // windows is clear confirmation that the uplink made it to the
     // network and was valid. However, compliance checks this, so
     // we have to handle it and retransmit.
-    else if (LMIC.txCnt != 0 && (LMIC.txrxFlags & TXRX_NACK) != 0)
+    if (LMIC.txCnt != 0 && (LMIC.txrxFlags & TXRX_NACK) != 0)
         {
         // grr.  we're confirmed but the network downlink did not
         // set the ACK bit. We know txCnt is non-zero, so this
@@ -2268,10 +2433,16 @@ static bit_t processDnData (void) {
     }
 }
 
+// number of transmissions allowed for a confirmed uplink.
+static u1_t getConfirmedAttempts(void) {
+    u1_t const attempts = LMIC.client.txConfAttempts;
+    return attempts != 0 ? attempts : TXCONF_ATTEMPTS;
+}
+
 // nothing was received this window.
 static bit_t processDnData_norx(void) {
     if( LMIC.txCnt != 0 ) {
-        if( LMIC.txCnt < TXCONF_ATTEMPTS ) {
+        if( LMIC.txCnt < getConfirmedAttempts() ) {
             // Per [1.0.3] section 18.4, it is recommended that the device adjust datarate down.
             // The spec is not clear about what should happen in case the data size is too large
             // for the new frame len, but it seems that we should leave theframe len at the new
@@ -2525,6 +2696,14 @@ static void engineUpdate_inner (void) {
 #if LMIC_DEBUG_LEVEL > 0
     LMIC_DEBUG_PRINTF("%"LMIC_PRId_ostime_t": engineUpdate, opmode=0x%x\n", os_getTime(), LMIC.opmode);
 #endif
+#if LMIC_ENABLE_class_c
+    // Class C reception holds the radio and the job; release both.
+    if( (LMIC.opmode & OP_CLASSC) != 0 ) {
+        os_clearCallback(&LMIC.osjob);
+        stopClassCRx();
+    }
+#endif
+
     // Check for ongoing state: scan or TX/RX transaction
     if( (LMIC.opmode & (OP_SCAN|OP_TXRXPEND|OP_SHUTDOWN)) != 0 )
         return;
@@ -2573,8 +2752,8 @@ static void engineUpdate_inner (void) {
             txbeg = LMIC.txend;
         }
         // Delayed TX or waiting for duty cycle?
-        if( (LMIC.globalDutyRate != 0 || (LMIC.opmode & OP_RNDTX) != 0)  &&  (txbeg - LMIC.globalDutyAvail) < 0 )
-            txbeg = LMIC.globalDutyAvail;
+        if( (LMIC.globalDutyRate != 0 || (LMIC.opmode & OP_RNDTX) != 0)  &&  os_extendTime(txbeg) < LMIC.globalDutyAvail )
+            txbeg = (ostime_t) LMIC.globalDutyAvail;
 #if !defined(DISABLE_BEACONS)
         // If we're tracking a beacon...
         // then make sure TX-RX transaction is complete before beacon
@@ -2648,6 +2827,10 @@ static void engineUpdate_inner (void) {
             LMICbandplan_updateTx(txbeg);
             // limit power to value asked in adr
             LMIC.radio_txpow = LMIC.txpow > LMIC.adrTxPow ? LMIC.adrTxPow : LMIC.txpow;
+#if LMIC_ENABLE_channel_stats
+            if (! jacc)
+                channelStatsUplink();
+#endif
             reportEventNoUpdate(EV_TXSTART);
             os_radio(RADIO_TX);
             return;
@@ -2660,8 +2843,13 @@ static void engineUpdate_inner (void) {
             txbeg += 1;  // TX delayed by one tick (insignificant amount of time)
     } else {
         // No TX pending - no scheduled RX
-        if( (LMIC.opmode & OP_TRACK) == 0 )
+        if( (LMIC.opmode & OP_TRACK) == 0 ) {
+#if LMIC_ENABLE_class_c
+            if( classCAllowed() )
+                startClassCRx(0);
+#endif
             return;
+        }
     }
 
 #if !defined(DISABLE_BEACONS)
@@ -2714,6 +2902,13 @@ static void engineUpdate_inner (void) {
                        e_.info   = osticks2ms(txbeg-now),
                        e_.info2  = LMIC.seqnoUp-1));
     LMIC_X_DEBUG_PRINTF("%"LMIC_PRId_ostime_t": next engine update in %"LMIC_PRId_ostime_t"\n", now, txbeg-TX_RAMPUP);
+#if LMIC_ENABLE_class_c
+    // listen until the uplink can go; the receive job updates the engine.
+    if( classCAllowed() ) {
+        startClassCRx(txbeg-TX_RAMPUP);
+        return;
+    }
+#endif
     os_setTimedCallback(&LMIC.osjob, txbeg-TX_RAMPUP, FUNC_ADDR(runEngineUpdate));
 }
 
@@ -2836,6 +3031,37 @@ void LMIC_clrTxData (void) {
     engineUpdate();
 }
 
+// \brief return the earliest time at which an uplink could start.
+// This takes band and global duty cycle limits into account for the current
+// data rate, but not a transaction that is already in progress. Unlike the
+// engine's own call of LMICbandplan_nextTx(), the channel selection is left
+// unchanged, so the next uplink still uses the channel the engine would pick.
+ostime_t LMIC_nextTxTime(void) {
+    u1_t const txChnl = LMIC.txChnl;
+    u1_t const datarate = LMIC.datarate;
+#if CFG_LMIC_EU_like
+    u1_t lastchnl[MAX_BANDS];
+    for (u1_t bi = 0; bi < MAX_BANDS; bi++)
+        lastchnl[bi] = LMIC.bands[bi].lastchnl;
+#endif
+
+    ostime_t const now = os_getTime();
+    ostime_t txbeg = LMICbandplan_nextTx(now);
+
+    LMIC.txChnl = txChnl;
+    LMIC.datarate = datarate;
+#if CFG_LMIC_EU_like
+    for (u1_t bi = 0; bi < MAX_BANDS; bi++)
+        LMIC.bands[bi].lastchnl = lastchnl[bi];
+#endif
+
+    if (LMIC.globalDutyRate != 0 && os_extendTime(txbeg) < LMIC.globalDutyAvail)
+        txbeg = (ostime_t) LMIC.globalDutyAvail;
+    if (txbeg - now < 0)
+        txbeg = now;
+    return txbeg;
+}
+
 dr_t LMIC_feasibleDataRateForFrame(dr_t dr, u1_t payloadSize) {
     if (payloadSize > MAX_LEN_PAYLOAD) {
         return dr;
@@ -3024,6 +3250,162 @@ void LMIC_setClockError(u2_t error) {
     LMIC.client.clockError = error;
 }
 
+// Sets the number of transmissions (including the first one) used for a
+// confirmed uplink before giving up with TXRX_NACK. Zero selects the
+// default, TXCONF_ATTEMPTS. Like the clock error, this survives LMIC_reset().
+void LMIC_setConfirmedAttempts(u1_t attempts) {
+    LMIC.client.txConfAttempts = attempts;
+}
+
+#if LMIC_ENABLE_class_c
+// Enables or disables continuous reception on the RX2 frequency and data rate
+// between transactions (LoRaWAN Class C). Downlinks received this way are
+// reported with EV_RXCOMPLETE and TXRX_DNW2. The network has to be told about
+// the device class separately. This survives LMIC_reset().
+void LMIC_setClassC(bit_t enabled) {
+    LMIC.client.classC = enabled;
+    // start or stop listening; without a session this would start joining.
+    if (LMIC.devaddr != 0)
+        engineUpdate();
+}
+#endif // LMIC_ENABLE_class_c
+
+#if LMIC_ENABLE_lbt_cad
+// Selects how regions with listen before talk check that the channel is clear
+// before a LoRa uplink: with channel activity detection, the radio looks for
+// LoRa preambles at the uplink's spreading factor for the whole LBT window and
+// reports the result by interrupt, leaving the CPU and SPI bus idle meanwhile.
+// CAD doesn't see other modulations, so this only meets the regulations where
+// those allow it; otherwise keep the default RSSI sampling. FSK uplinks always
+// sample the RSSI. This survives LMIC_reset().
+void LMIC_setLbtCad(bit_t enabled) {
+    LMIC.client.lbtCad = enabled;
+}
+#endif // LMIC_ENABLE_lbt_cad
+
+// Returns the uplink frequency of a channel, or 0 if the channel is disabled.
+u4_t LMIC_getChannelFreq(u1_t channel) {
+    return LMICbandplan_channelFreq(channel);
+}
+
+// Measures the RSSI on freq for nTicks with a 125 kHz bandwidth, for surveying
+// the noise floor between transactions. Returns 0 without measuring if the
+// radio is in use, or if a job such as a receive window, a beacon, a ping slot
+// or the next uplink is due before the measurement would end.
+bit_t LMIC_monitorRssi(u4_t freq, ostime_t nTicks, oslmic_radio_rssi_t *pRssi) {
+    if ((LMIC.opmode & (OP_TXRXPEND | OP_SCAN | OP_CLASSC | OP_SHUTDOWN)) != 0 ||
+        os_queryTimeCriticalJobs(nTicks + ms2osticks(10)))
+        return 0;
+
+    u4_t const freqSaved = LMIC.freq;
+    rps_t const rpsSaved = LMIC.rps;
+    LMIC.freq = freq;
+    LMIC.rps = makeRps(SF7, BW125, CR_4_5, 0, 0);
+    // the radio driver runs with interrupts disabled, like in os_radio()
+    hal_disableIRQs();
+    radio_monitor_rssi(nTicks, pRssi);
+    hal_enableIRQs();
+    LMIC.freq = freqSaved;
+    LMIC.rps = rpsSaved;
+    return 1;
+}
+
+#if LMIC_MULTICAST_GROUPS > 0
+// Makes the device a member of a multicast group, with the session the
+// network server set up for it. Frames for the group are reported like
+// unicast ones, with LMIC.dataGroup set to the group. The sessions are part
+// of the MAC state and are cleared by LMIC_reset(). Returns 0 if the group
+// number or the address is invalid.
+bit_t LMIC_setMulticastSession(u1_t group, devaddr_t addr, xref2cu1_t nwkKey, xref2cu1_t artKey, u4_t seqnoDn) {
+    if (group >= LMIC_MULTICAST_GROUPS || addr == 0 || addr == LMIC.devaddr)
+        return 0;
+    lmic_multicast_session_t * const pSession = &LMIC.multicast[group];
+    pSession->addr = addr;
+    pSession->seqnoDn = seqnoDn;
+    os_copyMem(pSession->nwkKey, nwkKey, sizeof(pSession->nwkKey));
+    os_copyMem(pSession->artKey, artKey, sizeof(pSession->artKey));
+    return 1;
+}
+
+void LMIC_clearMulticastSession(u1_t group) {
+    if (group < LMIC_MULTICAST_GROUPS)
+        os_clearMem(&LMIC.multicast[group], sizeof(LMIC.multicast[group]));
+}
+#endif // LMIC_MULTICAST_GROUPS > 0
+
+#if LMIC_ENABLE_channel_stats
+// Selects whether channels are chosen at random weighted by their delivery
+// statistics (see LMICcore_channelWeight()), or by the band plan's default
+// rotation. Band duty cycle limits apply either way. This survives LMIC_reset().
+void LMIC_setAdaptiveChannels(bit_t enabled) {
+    LMIC.client.adaptiveChannels = enabled;
+}
+
+// Returns the statistics of a channel, or NULL if the channel isn't tracked.
+const lmic_channel_stats_t *LMIC_getChannelStats(u1_t channel) {
+    if (channel >= LMIC_CHANNEL_STATS_COUNT)
+        return NULL;
+    return &LMIC.channelStats[channel];
+}
+
+void LMIC_resetChannelStats(void) {
+    os_clearMem((xref2u1_t)LMIC.channelStats, sizeof(LMIC.channelStats));
+}
+
+// halve the counts of a channel once it reaches the window, so that old
+// results fade out.
+static void channelStatsAge(lmic_channel_stats_t *pStats) {
+    if (pStats->uplinks < LMIC_CHANNEL_STATS_WINDOW)
+        return;
+    pStats->uplinks /= 2;
+    pStats->confirmed /= 2;
+    pStats->acknowledged /= 2;
+    pStats->downlinks /= 2;
+    pStats->busy /= 2;
+}
+
+// a data frame is about to be sent on LMIC.txChnl.
+static void channelStatsUplink(void) {
+    if (LMIC.txChnl >= LMIC_CHANNEL_STATS_COUNT)
+        return;
+    lmic_channel_stats_t * const pStats = &LMIC.channelStats[LMIC.txChnl];
+    channelStatsAge(pStats);
+    pStats->uplinks += 1;
+    if (LMIC.txCnt != 0)
+        pStats->confirmed += 1;
+}
+
+// a downlink was accepted after the uplink on LMIC.txChnl.
+static void channelStatsDownlink(void) {
+    if (LMIC.txChnl >= LMIC_CHANNEL_STATS_COUNT)
+        return;
+    lmic_channel_stats_t * const pStats = &LMIC.channelStats[LMIC.txChnl];
+    pStats->downlinks += 1;
+    if (LMIC.txrxFlags & TXRX_ACK)
+        pStats->acknowledged += 1;
+}
+
+// Returns the selection weight of a channel, from 16 to 256: the product of
+// the acknowledged fraction of confirmed uplinks and the fraction of attempts
+// not blocked by LBT. Each fraction starts from one assumed success and one
+// assumed failure, so a channel without history weighs about 1/4 of the
+// maximum. The floor keeps channels that did badly in occasional use, so
+// they are picked up again once they recover. Without adaptive selection,
+// all channels weigh the same.
+u2_t LMICcore_channelWeight(u1_t chnl) {
+    if (! LMIC.client.adaptiveChannels || chnl >= LMIC_CHANNEL_STATS_COUNT)
+        return 256;
+
+    const lmic_channel_stats_t * const pStats = &LMIC.channelStats[chnl];
+    u4_t const clearAttempts = pStats->uplinks - pStats->busy;
+    u4_t const delivery = ((u4_t)pStats->acknowledged + 1) * 256 / ((u4_t)pStats->confirmed + 2);
+    u4_t const clear = (clearAttempts + 1) * 256 / ((u4_t)pStats->uplinks + 2);
+    u4_t const weight = delivery * clear / 256;
+
+    return weight < 16 ? 16 : (u2_t)weight;
+}
+#endif // LMIC_ENABLE_channel_stats
+
 // \brief return the uplink sequence number for the next transmission.
 // This simple getter returns the uplink sequence number maintained by the LMIC engine.
 // The caller should store the value and restore it (see LMIC_setSeqnoUp) on
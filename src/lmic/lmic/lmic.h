@@ -158,10 +158,10 @@ enum { MAX_BANDS    =  4 };
 enum { LIMIT_CHANNELS = (1<<4) };   // EU868 will never have more channels
 //! \internal
 struct band_t {
+    ostime64_t avail;   // channel is blocked until this time
     u2_t     txcap;     // duty cycle limitation: 1/txcap
     s1_t     txpow;     // maximum TX power
     u1_t     lastchnl;  // last used channel
-    ostime_t avail;     // channel is blocked until this time
 };
 TYPEDEF_xref2band_t; //!< \internal
 
@@ -246,6 +246,7 @@ enum { OP_NONE     = 0x0000,
        OP_LINKDEAD = 0x1000, // link was reported as dead
        OP_TESTMODE = 0x2000, // developer test mode
        OP_UNJOIN   = 0x4000, // unjoin and rejoin on next engineUpdate().
+       OP_CLASSC   = 0x8000, // continuous (Class C) receive on RX2 in progress
 };
 // TX-RX transaction flags - report back to user
 enum { TXRX_ACK    = 0x80,   // confirmed UP frame was acked
@@ -435,9 +436,84 @@ struct lmic_client_data_s {
     u2_t        clockError;                 //! Inaccuracy in the clock. CLOCK_ERROR_MAX represents +/-100% error
 
     /* finally, things that are (u)int8_t */
-    /* none at the moment */
+    u1_t        txConfAttempts;             //! transmit attempts for confirmed frames; 0 ==> TXCONF_ATTEMPTS
+#if LMIC_ENABLE_channel_stats
+    u1_t        adaptiveChannels;           //! weight channel selection by delivery statistics
+#endif
+#if LMIC_ENABLE_class_c
+    u1_t        classC;                     //! listen on RX2 between transactions
+#endif
+#if LMIC_ENABLE_lbt_cad
+    u1_t        lbtCad;                     //! listen before talk with channel activity detection
+#endif
+};
+
+// Number of uplink channels of the band plan, see LMIC_getChannelFreq()
+#if CFG_LMIC_EU_like
+enum { LMIC_CHANNEL_COUNT = MAX_CHANNELS };
+#elif CFG_LMIC_US_like
+enum { LMIC_CHANNEL_COUNT = 72 };
+#endif
+
+#if LMIC_ENABLE_channel_stats
+/*
+
+Structure:  lmic_channel_stats_t
+
+Function:
+    Delivery statistics for one uplink channel.
+
+Description:
+    Counts are per transmission attempt, so each retransmission of a
+    confirmed uplink counts separately. When the attempts on a channel reach
+    LMIC_CHANNEL_STATS_WINDOW, all its counts are halved, so that the
+    statistics follow changes in interference.
+
+*/
+
+typedef struct lmic_channel_stats_s lmic_channel_stats_t;
+
+struct lmic_channel_stats_s {
+    u2_t        uplinks;        // data frames sent on the channel
+    u2_t        confirmed;      // of those, confirmed frames
+    u2_t        acknowledged;   // confirmed frames that got an ACK
+    u2_t        downlinks;      // uplinks followed by a downlink
+    u2_t        busy;           // TX attempts dropped because LBT found the channel busy
 };
 
+enum { LMIC_CHANNEL_STATS_WINDOW = 256 };
+enum { LMIC_CHANNEL_STATS_COUNT = LMIC_CHANNEL_COUNT };
+#endif // LMIC_ENABLE_channel_stats
+
+#if LMIC_MULTICAST_GROUPS > 0
+/*
+
+Structure:  lmic_multicast_session_t
+
+Function:
+    Session of one multicast group the device is a member of.
+
+Description:
+    Each group has its own address, keys and downlink frame counter, so a
+    multicast frame never touches the unicast session. The network server
+    distributes these (for instance with the remote multicast setup
+    package); the application passes them to LMIC_setMulticastSession().
+
+*/
+
+typedef struct lmic_multicast_session_s lmic_multicast_session_t;
+
+struct lmic_multicast_session_s {
+    devaddr_t   addr;           // McAddr, 0 if the group is not in use
+    u4_t        seqnoDn;        // next expected McFCntDown
+    u1_t        nwkKey[16];     // McNwkSKey
+    u1_t        artKey[16];     // McAppSKey
+};
+#endif // LMIC_MULTICAST_GROUPS > 0
+
+// Multicast group of a unicast downlink
+enum { LMIC_MULTICAST_NONE = 0xFF };
+
 /*
 
 Structure:  lmic_radio_data_t
@@ -462,6 +538,18 @@ struct lmic_radio_data_s {
     ostime_t    txlate_ticks;
     // number of tx late launches.
     unsigned    txlate_count;
+    // total os ticks from radio interrupts to their handling. Can overflow!
+    ostime_t    irq_latency_ticks;
+    // longest time from a radio interrupt to its handling.
+    ostime_t    irq_latency_max;
+    // number of radio interrupts handled.
+    unsigned    irq_count;
+#if LMIC_ENABLE_lbt_cad
+    // end of the listen-before-talk window while CAD is running, 0 otherwise.
+    ostime_t    cad_end;
+    // number of CAD cycles run for listen before talk.
+    unsigned    cad_count;
+#endif
 };
 
 /*
@@ -502,7 +590,7 @@ struct lmic_t {
 
     u4_t        freq;
 
-    ostime_t    globalDutyAvail; // time device can send again
+    ostime64_t  globalDutyAvail; // time device can send again
 
     u4_t        netid;        // current network id (~0 - none)
     devaddr_t   devaddr;
@@ -521,6 +609,14 @@ struct lmic_t {
                                     // zero ==> not valid.
 #endif // LMIC_ENABLE_DeviceTimeReq
 
+#if LMIC_ENABLE_channel_stats
+    lmic_channel_stats_t channelStats[LMIC_CHANNEL_STATS_COUNT];
+#endif
+
+#if LMIC_MULTICAST_GROUPS > 0
+    lmic_multicast_session_t multicast[LMIC_MULTICAST_GROUPS];
+#endif
+
     // Channel scheduling -- very much private
 #if CFG_LMIC_EU_like
     band_t      bands[MAX_BANDS];
@@ -531,6 +627,9 @@ struct lmic_t {
     // bit map of enabled datarates for each channel
     u2_t        channelDrMap[MAX_CHANNELS];
     u2_t        channelMap;
+    // bit map of enabled channels for each band and datarate; derived from
+    // the above by LMICeulike_updateChannelMasks().
+    u2_t        channelBandDrMap[MAX_BANDS][16];
 #elif CFG_LMIC_US_like
     u4_t        xchFreq[MAX_XCHANNELS];    // extra channel frequencies (if device is behind a repeater)
     u2_t        xchDrMap[MAX_XCHANNELS];   // extra channel datarate ranges  ---XXX: ditto
@@ -629,12 +728,18 @@ struct lmic_t {
 #if !defined(DISABLE_BEACONS)
     u1_t        missedBcns;   // unable to track last N beacons
     u1_t        bcninfoTries; // how often to try (scan mode only)
+#endif
+#if !defined(DISABLE_PING)
+    u1_t        pingSlotInfoReq; // non-zero until the network answers PingSlotInfoReq
 #endif
     // Public part of MAC state
     u1_t        txCnt;
     u1_t        txrxFlags;  // transaction flags (TX-RX combo)
     u1_t        dataBeg;    // 0 or start of data (dataBeg-1 is port)
     u1_t        dataLen;    // 0 no data or zero length data, >0 byte count of data
+#if LMIC_MULTICAST_GROUPS > 0
+    u1_t        dataGroup;  // multicast group of the data, LMIC_MULTICAST_NONE for unicast
+#endif
     u1_t        frame[MAX_LEN_FRAME];
 
 #if !defined(DISABLE_BEACONS)
@@ -673,6 +778,7 @@ void  LMIC_shutdown     (void);
 void  LMIC_init         (void);
 void  LMIC_reset        (void);
 void  LMIC_clrTxData    (void);
+ostime_t LMIC_nextTxTime (void);
 void  LMIC_setTxData    (void);
 void  LMIC_setTxData_strict(void);
 lmic_tx_error_t LMIC_setTxData2(u1_t port, xref2u1_t data, u1_t dlen, u1_t confirmed);
@@ -694,6 +800,29 @@ void  LMIC_setPingable   (u1_t intvExp);
 void LMIC_setSession (u4_t netid, devaddr_t devaddr, xref2u1_t nwkKey, xref2u1_t artKey);
 void LMIC_setLinkCheckMode (bit_t enabled);
 void LMIC_setClockError(u2_t error);
+void LMIC_setConfirmedAttempts(u1_t attempts);
+
+#if LMIC_ENABLE_channel_stats
+void LMIC_setAdaptiveChannels(bit_t enabled);
+const lmic_channel_stats_t *LMIC_getChannelStats(u1_t channel);
+void LMIC_resetChannelStats(void);
+#endif
+
+#if LMIC_ENABLE_class_c
+void LMIC_setClassC(bit_t enabled);
+#endif
+
+#if LMIC_ENABLE_lbt_cad
+void LMIC_setLbtCad(bit_t enabled);
+#endif
+
+u4_t  LMIC_getChannelFreq(u1_t channel);
+bit_t LMIC_monitorRssi(u4_t freq, ostime_t nTicks, oslmic_radio_rssi_t *pRssi);
+
+#if LMIC_MULTICAST_GROUPS > 0
+bit_t LMIC_setMulticastSession(u1_t group, devaddr_t addr, xref2cu1_t nwkKey, xref2cu1_t artKey, u4_t seqnoDn);
+void LMIC_clearMulticastSession(u1_t group);
+#endif
 
 u4_t LMIC_getSeqnoUp    (void);
 u4_t LMIC_setSeqnoUp    (u4_t);
@@ -189,11 +189,12 @@ void LMICas923_initDefaultChannels(bit_t join) {
                 LMIC.channelFreq[fu] = TABLE_GET_U4(iniChannelFreq, fu);
                 LMIC.channelDrMap[fu] = DR_RANGE_MAP(AS923_DR_SF12, AS923_DR_SF7B);
         }
+        LMICeulike_updateChannelMasks(LMICeulike_ALL_CHANNELS);
 
         LMIC.bands[BAND_CENTI].txcap = AS923_TX_CAP;
         LMIC.bands[BAND_CENTI].txpow = AS923_TX_EIRP_MAX_DBM;
         LMIC.bands[BAND_CENTI].lastchnl = os_getRndU1() % MAX_CHANNELS;
-        LMIC.bands[BAND_CENTI].avail = os_getTime();
+        LMIC.bands[BAND_CENTI].avail = os_getTime64();
 }
 
 void
@@ -221,7 +222,7 @@ bit_t LMIC_setupBand(u1_t bandidx, s1_t txpow, u2_t txcap) {
         xref2band_t b = &LMIC.bands[bandidx];
         b->txpow = txpow;
         b->txcap = txcap;
-        b->avail = os_getTime();
+        b->avail = os_getTime64();
         b->lastchnl = os_getRndU1() % MAX_CHANNELS;
         return 1;
 }
@@ -255,6 +256,7 @@ bit_t LMIC_setupChannel(u1_t chidx, u4_t freq, u2_t drmap, s1_t band) {
                 LMIC.channelMap |= 1 << chidx;  // enabled right away
         else
                 LMIC.channelMap &= ~(1 << chidx);
+        LMICeulike_updateChannelMasks(1 << chidx);
         return 1;
 }
 
@@ -270,9 +272,9 @@ u4_t LMICas923_convFreq(xref2cu1_t ptr) {
 // when can we join next?
 ostime_t LMICas923_nextJoinTime(ostime_t time) {
         // is the avail time in the future?
-        if ((s4_t) (time - LMIC.bands[BAND_CENTI].avail) < 0)
+        if (os_extendTime(time) < LMIC.bands[BAND_CENTI].avail)
                 // yes: then wait until then.
-                time = LMIC.bands[BAND_CENTI].avail;
+                time = (ostime_t) LMIC.bands[BAND_CENTI].avail;
 
         return time;
 }
@@ -320,31 +322,35 @@ void LMICas923_setRx1Params(void) {
 // identical to the EU868 version; but note that we only have BAND_CENTI
 // at work.
 ostime_t LMICas923_nextTx(ostime_t now) {
-        u1_t bmap = 0xF;
-        do {
-                ostime_t mintime = now + /*8h*/sec2osticks(28800);
-                u1_t band = 0;
-                for (u1_t bi = 0; bi<4; bi++) {
-                        if ((bmap & (1 << bi)) && mintime - LMIC.bands[bi].avail > 0)
-                                mintime = LMIC.bands[band = bi].avail;
-                }
-                // Find next channel in given band
-                u1_t chnl = LMIC.bands[band].lastchnl;
-                for (u1_t ci = 0; ci<MAX_CHANNELS; ci++) {
-                        if ((chnl = (chnl + 1)) >= MAX_CHANNELS)
-                                chnl -= MAX_CHANNELS;
-                        if ((LMIC.channelMap & (1 << chnl)) != 0 &&  // channel enabled
-                                (LMIC.channelDrMap[chnl] & (1 << (LMIC.datarate & 0xF))) != 0 &&
-                                band == (LMIC.channelFreq[chnl] & 0x3)) { // in selected band
-                                LMIC.txChnl = LMIC.bands[band].lastchnl = chnl;
-                                return mintime;
-                        }
-                }
-                if ((bmap &= ~(1 << band)) == 0) {
-                        // No feasible channel  found!
-                        return mintime;
-                }
-        } while (1);
+        u1_t const dr = LMIC.datarate & 0xF;
+
+        // consider only bands with an enabled channel for this data rate
+        u1_t bmap = 0;
+        for (u1_t bi = 0; bi<MAX_BANDS; bi++) {
+                if (LMIC.channelBandDrMap[bi][dr] != 0)
+                        bmap |= 1 << bi;
+        }
+        // No feasible channel: keep the current one, and wait for any band
+        if (bmap == 0)
+                bmap = 0xF;
+
+        // compared in 64 bits, so bands unused for longer than half the
+        // 32-bit clock period don't appear to be blocked.
+        ostime64_t const now64 = os_extendTime(now);
+        ostime64_t mintime = now64 + /*8h*/sec2osticks(28800);
+        u1_t band = 0;
+        for (u1_t bi = 0; bi<MAX_BANDS; bi++) {
+                if ((bmap & (1 << bi)) && mintime > LMIC.bands[bi].avail)
+                        mintime = LMIC.bands[band = bi].avail;
+        }
+        if (mintime < now64)
+                mintime = now64;
+
+        // Find next channel in given band
+        u2_t const mask = LMIC.channelBandDrMap[band][dr];
+        if (mask != 0)
+                LMIC.txChnl = LMIC.bands[band].lastchnl = LMICeulike_nextChannel(mask, LMIC.bands[band].lastchnl);
+        return (ostime_t) mintime;
 }
 
 #if !defined(DISABLE_BEACONS)
@@ -379,7 +385,7 @@ LMICas923_updateTx(ostime_t txbeg) {
         xref2band_t band = &LMIC.bands[freq & 0x3];
         LMIC.freq = freq & ~(u4_t)3;
         LMIC.txpow = LMICas923_getMaxEIRP(LMIC.txParam);
-        band->avail = txbeg + airtime * band->txcap;
+        band->avail = os_extendTime(txbeg) + airtime * band->txcap;
         dwellDelay = globalDutyDelay = 0;
         if (LMIC.globalDutyRate != 0) {
                 globalDutyDelay = (airtime << LMIC.globalDutyRate);
@@ -391,7 +397,7 @@ LMICas923_updateTx(ostime_t txbeg) {
                 globalDutyDelay = dwellDelay;
         }
         if (globalDutyDelay != 0)
-                LMIC.globalDutyAvail = txbeg + globalDutyDelay;
+                LMIC.globalDutyAvail = os_extendTime(txbeg) + globalDutyDelay;
 }
 
 
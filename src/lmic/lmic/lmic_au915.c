@@ -74,13 +74,13 @@ LMICau915_getUplinkDwellBit() {
 
 uint8_t LMICau915_maxFrameLen(uint8_t dr) {
         if (LMICau915_getUplinkDwellBit()) {
-                if (dr < LENOF_TABLE(maxFrameLens_dwell0))
-                        return TABLE_GET_U1(maxFrameLens_dwell0, dr);
+                if (dr < LENOF_TABLE(maxFrameLens_dwell1))
+                        return TABLE_GET_U1(maxFrameLens_dwell1, dr);
                 else
                         return 0;
         } else {
-                if (dr < LENOF_TABLE(maxFrameLens_dwell1))
-                        return TABLE_GET_U1(maxFrameLens_dwell1, dr);
+                if (dr < LENOF_TABLE(maxFrameLens_dwell0))
+                        return TABLE_GET_U1(maxFrameLens_dwell0, dr);
                 else
                         return 0;
         }
@@ -229,6 +229,14 @@ bit_t LMIC_selectSubBand(u1_t band) {
         return result;
 }
 
+u4_t LMICau915_channelFreq(u1_t chnl) {
+        if (chnl >= 64 + 8 || !ENABLED_CHANNEL(chnl))
+                return 0;
+        if (chnl < 64)
+                return AU915_125kHz_UPFBASE + chnl*AU915_125kHz_UPFSTEP;
+        return AU915_500kHz_UPFBASE + (chnl - 64)*AU915_500kHz_UPFSTEP;
+}
+
 void LMICau915_updateTx(ostime_t txbeg) {
         u1_t chnl = LMIC.txChnl;
         LMIC.txpow = LMICau915_getMaxEIRP(LMIC.txParam);
@@ -255,7 +263,7 @@ void LMICau915_updateTx(ostime_t txbeg) {
                 globalDutyDelay = dwellDelay;
         }
         if (globalDutyDelay != 0) {
-                LMIC.globalDutyAvail = txbeg + globalDutyDelay;
+                LMIC.globalDutyAvail = os_extendTime(txbeg) + globalDutyDelay;
         }
 }
 
@@ -242,7 +242,7 @@ void LMICau921_updateTx(ostime_t txbeg) {
         // Update global duty cycle stats
         if (LMIC.globalDutyRate != 0) {
                 ostime_t airtime = calcAirTime(LMIC.rps, LMIC.dataLen);
-                LMIC.globalDutyAvail = txbeg + (airtime << LMIC.globalDutyRate);
+                LMIC.globalDutyAvail = os_extendTime(txbeg) + (airtime << LMIC.globalDutyRate);
         }
 }
 
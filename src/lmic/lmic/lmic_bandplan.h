@@ -134,6 +134,10 @@
 # error "LMICbandplan_updateTx() not defined by bandplan"
 #endif
 
+#if !defined(LMICbandplan_channelFreq)
+# error "LMICbandplan_channelFreq() not defined by bandplan"
+#endif
+
 #if !defined(LMICbandplan_nextJoinState)
 # error "LMICbandplan_nextJoinState() not defined by bandplan"
 #endif
@@ -227,5 +231,8 @@
 ostime_t LMICcore_rndDelay(u1_t secSpan);
 void LMICcore_setDrJoin(u1_t reason, u1_t dr);
 ostime_t LMICcore_adjustForDrift(ostime_t delay, ostime_t hsym, rxsyms_t rxsyms_in);
+#if LMIC_ENABLE_channel_stats
+u2_t LMICcore_channelWeight(u1_t chnl);
+#endif
 
 #endif // _lmic_bandplan_h_
@@ -66,4 +66,7 @@ void LMICau915_setRx1Params(void);
 void LMICau915_updateTx(ostime_t txbeg);
 #define LMICbandplan_updateTx(txbeg)    LMICau915_updateTx(txbeg)
 
+u4_t LMICau915_channelFreq(u1_t chnl);
+#define LMICbandplan_channelFreq(chnl)  LMICau915_channelFreq(chnl)
+
 #endif // _lmic_bandplan_au915_h_
@@ -66,4 +66,7 @@ void LMICus915_setRx1Params(void);
 void LMICus915_updateTx(ostime_t txbeg);
 #define LMICbandplan_updateTx(txbeg)    LMICus915_updateTx(txbeg)
 
+u4_t LMICus915_channelFreq(u1_t chnl);
+#define LMICbandplan_channelFreq(chnl)  LMICus915_channelFreq(chnl)
+
 #endif // _lmic_bandplan_us915_h_
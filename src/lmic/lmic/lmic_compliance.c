@@ -220,7 +220,7 @@ static void evActivate(void) {
         for (; b < &LMIC.bands[MAX_BANDS]; ++b, ++b_save) {
             b_save->txcap = b->txcap;
             b->txcap = 1;
-            b->avail = os_getTime();
+            b->avail = os_getTime64();
         }
 #endif // CFG_LMIC_EU_like
 
@@ -113,6 +113,7 @@ void LMICeu868_initDefaultChannels(bit_t join) {
                 // TODO(tmm@mcci.com): don't use EU DR directly, use something from the LMIC context or a static const
                 LMIC.channelDrMap[fu] = DR_RANGE_MAP(EU868_DR_SF12, EU868_DR_SF7);
         }
+        LMICeulike_updateChannelMasks(LMICeulike_ALL_CHANNELS);
 
         (void) LMIC_setupBand(BAND_MILLI, 14 /* dBm */, 1000 /* 0.1% */);
         (void) LMIC_setupBand(BAND_CENTI, 14 /* dBm */,  100 /* 1% */);
@@ -125,7 +126,7 @@ bit_t LMIC_setupBand(u1_t bandidx, s1_t txpow, u2_t txcap) {
         xref2band_t b = &LMIC.bands[bandidx];
         b->txpow = txpow;
         b->txcap = txcap;
-        b->avail = os_getTime();
+        b->avail = os_getTime64();
         b->lastchnl = os_getRndU1() % MAX_CHANNELS;
         return 1;
 }
@@ -183,6 +184,7 @@ bit_t LMIC_setupChannel(u1_t chidx, u4_t freq, u2_t drmap, s1_t band) {
                 LMIC.channelMap |= 1 << chidx;  // enabled right away
         else
                 LMIC.channelMap &= ~(1 << chidx);
+        LMICeulike_updateChannelMasks(1 << chidx);
         return 1;
 }
 
@@ -197,39 +199,75 @@ u4_t LMICeu868_convFreq(xref2cu1_t ptr) {
 
 ostime_t LMICeu868_nextJoinTime(ostime_t time) {
         // is the avail time in the future?
-        if ((s4_t) (time - LMIC.bands[BAND_MILLI].avail) < 0)
+        if (os_extendTime(time) < LMIC.bands[BAND_MILLI].avail)
                 // yes: then wait until then.
-                time = LMIC.bands[BAND_MILLI].avail;
+                time = (ostime_t) LMIC.bands[BAND_MILLI].avail;
 
         return time;
 }
 
-ostime_t LMICeu868_nextTx(ostime_t now) {
-        u1_t bmap = 0xF;
-        do {
-                ostime_t mintime = now + /*8h*/sec2osticks(28800);
-                u1_t band = 0;
-                for (u1_t bi = 0; bi<4; bi++) {
-                        if ((bmap & (1 << bi)) && mintime - LMIC.bands[bi].avail > 0)
-                                mintime = LMIC.bands[band = bi].avail;
+#if LMIC_ENABLE_channel_stats
+// pick a channel from mask at random, weighted by LMICcore_channelWeight().
+static u1_t pickWeightedChannel(u2_t mask) {
+        u4_t total = 0;
+        for (u1_t chnl = 0; chnl < MAX_CHANNELS; chnl++) {
+                if ((mask & (1 << chnl)) != 0)
+                        total += LMICcore_channelWeight(chnl);
+        }
+
+        u4_t pick = os_getRndU2() % total;
+        for (u1_t chnl = 0; chnl < MAX_CHANNELS; chnl++) {
+                if ((mask & (1 << chnl)) != 0) {
+                        u2_t const weight = LMICcore_channelWeight(chnl);
+                        if (pick < weight)
+                                return chnl;
+                        pick -= weight;
                 }
+        }
+        return LMICeulike_nextChannel(mask, 0);
+}
+#endif // LMIC_ENABLE_channel_stats
+
+ostime_t LMICeu868_nextTx(ostime_t now) {
+        u1_t const dr = LMIC.datarate & 0xF;
+
+        // consider only bands with an enabled channel for this data rate
+        u1_t bmap = 0;
+        for (u1_t bi = 0; bi<MAX_BANDS; bi++) {
+                if (LMIC.channelBandDrMap[bi][dr] != 0)
+                        bmap |= 1 << bi;
+        }
+        // No feasible channel: keep the current one, and wait for any band
+        if (bmap == 0)
+                bmap = 0xF;
+
+        // compared in 64 bits, so bands unused for longer than half the
+        // 32-bit clock period don't appear to be blocked.
+        ostime64_t const now64 = os_extendTime(now);
+        ostime64_t mintime = now64 + /*8h*/sec2osticks(28800);
+        u1_t band = 0;
+        for (u1_t bi = 0; bi<MAX_BANDS; bi++) {
+                if ((bmap & (1 << bi)) && mintime > LMIC.bands[bi].avail)
+                        mintime = LMIC.bands[band = bi].avail;
+        }
+        if (mintime < now64)
+                mintime = now64;
+
+        u2_t const mask = LMIC.channelBandDrMap[band][dr];
+        if (mask == 0)
+                return (ostime_t) mintime;
+
+        u1_t chnl;
+#if LMIC_ENABLE_channel_stats
+        if (LMIC.client.adaptiveChannels)
+                chnl = pickWeightedChannel(mask);
+        else
+#endif
                 // Find next channel in given band
-                u1_t chnl = LMIC.bands[band].lastchnl;
-                for (u1_t ci = 0; ci<MAX_CHANNELS; ci++) {
-                        if ((chnl = (chnl + 1)) >= MAX_CHANNELS)
-                                chnl -= MAX_CHANNELS;
-                        if ((LMIC.channelMap & (1 << chnl)) != 0 &&  // channel enabled
-                                (LMIC.channelDrMap[chnl] & (1 << (LMIC.datarate & 0xF))) != 0 &&
-                                band == (LMIC.channelFreq[chnl] & 0x3)) { // in selected band
-                                LMIC.txChnl = LMIC.bands[band].lastchnl = chnl;
-                                return mintime;
-                        }
-                }
-                if ((bmap &= ~(1 << band)) == 0) {
-                        // No feasible channel  found!
-                        return mintime;
-                }
-        } while (1);
+                chnl = LMICeulike_nextChannel(mask, LMIC.bands[band].lastchnl);
+
+        LMIC.txChnl = LMIC.bands[band].lastchnl = chnl;
+        return (ostime_t) mintime;
 }
 
 
@@ -47,6 +47,7 @@ bit_t LMIC_disableChannel(u1_t channel) {
         LMIC.channelFreq[channel] = 0;
         LMIC.channelDrMap[channel] = 0;
         LMIC.channelMap = old_chmap & ~(1 << channel);
+        LMICeulike_updateChannelMasks(1 << channel);
         return LMIC.channelMap != old_chmap;
 }
 
@@ -83,6 +84,8 @@ bit_t LMICeulike_canMapChannels(u1_t chpage, u2_t chmap) {
 // chpage is 0 or 0x60; 0x60 turns all on; 0 selects channels 0..15 via mask.
 // Assumes canMapChannels has already approved this change.
 bit_t LMICeulike_mapChannels(u1_t chpage, u2_t chmap) {
+    u2_t const old_chmap = LMIC.channelMap;
+
     switch (chpage) {
         case MCMD_LinkADRReq_ChMaskCntl_EULIKE_DIRECT:
             LMIC.channelMap = chmap;
@@ -103,6 +106,7 @@ bit_t LMICeulike_mapChannels(u1_t chpage, u2_t chmap) {
             // do nothing.
             break;
     }
+    LMICeulike_updateChannelMasks(old_chmap ^ LMIC.channelMap);
     return LMIC.channelMap != 0;
 }
 
@@ -115,14 +119,35 @@ bit_t LMICeulike_isDataRateFeasible(dr_t dr) {
         return 0;
     }
 #endif
-        for (u1_t chnl = 0; chnl < MAX_CHANNELS; ++chnl) {
-                if ((LMIC.channelMap & (1 << chnl)) != 0 &&  // channel enabled
-                        (LMIC.channelDrMap[chnl] & (1 << dr)) != 0)
-                                return 1;
+        for (u1_t band = 0; band < MAX_BANDS; ++band) {
+                if (LMIC.channelBandDrMap[band][dr & 0xF] != 0)
+                        return 1;
         }
         return 0;
 }
 
+void LMICeulike_updateChannelMasks(u2_t changed) {
+        for (u1_t chnl = 0; chnl < MAX_CHANNELS; ++chnl) {
+                u2_t const bit = 1 << chnl;
+                if ((changed & bit) == 0)
+                        continue;
+
+                for (u1_t band = 0; band < MAX_BANDS; ++band)
+                        for (u1_t dr = 0; dr < 16; ++dr)
+                                LMIC.channelBandDrMap[band][dr] &= ~bit;
+
+                if ((LMIC.channelMap & bit) == 0)
+                        continue;
+
+                u1_t const band = LMIC.channelFreq[chnl] & 0x3;
+                u2_t const drMap = LMIC.channelDrMap[chnl];
+                for (u1_t dr = 0; dr < 16; ++dr) {
+                        if ((drMap & (1 << dr)) != 0)
+                                LMIC.channelBandDrMap[band][dr] |= bit;
+                }
+        }
+}
+
 #if !defined(DISABLE_JOIN)
 void LMICeulike_initJoinLoop(uint8_t nDefaultChannels, s1_t adrTxPow) {
 #if CFG_TxContinuousMode
@@ -140,6 +165,12 @@ void LMICeulike_initJoinLoop(uint8_t nDefaultChannels, s1_t adrTxPow) {
 }
 #endif // DISABLE_JOIN
 
+u4_t LMICeulike_channelFreq(u1_t chnl) {
+        if (chnl >= MAX_CHANNELS || (LMIC.channelMap & (1 << chnl)) == 0)
+                return 0;
+        return LMIC.channelFreq[chnl] & ~(u4_t)3;
+}
+
 void LMICeulike_updateTx(ostime_t txbeg) {
         u4_t freq = LMIC.channelFreq[LMIC.txChnl];
         // Update global/band specific duty cycle stats
@@ -148,9 +179,9 @@ void LMICeulike_updateTx(ostime_t txbeg) {
         xref2band_t band = &LMIC.bands[freq & 0x3];
         LMIC.freq = freq & ~(u4_t)3;
         LMIC.txpow = band->txpow;
-        band->avail = txbeg + airtime * band->txcap;
+        band->avail = os_extendTime(txbeg) + airtime * band->txcap;
         if (LMIC.globalDutyRate != 0)
-                LMIC.globalDutyAvail = txbeg + (airtime << LMIC.globalDutyRate);
+                LMIC.globalDutyAvail = os_extendTime(txbeg) + (airtime << LMIC.globalDutyRate);
 }
 
 #if !defined(DISABLE_JOIN)
@@ -242,6 +273,7 @@ void LMICeulike_restoreAdrState(const lmic_saved_adr_state_t *pStateBuffer) {
             sizeof(LMIC.channelFreq)
             );
     LMIC.channelMap = pStateBuffer->channelMap;
+    LMICeulike_updateChannelMasks(LMICeulike_ALL_CHANNELS);
 }
 
 void LMICeulike_setRx1Freq(void) {
@@ -86,6 +86,9 @@ void LMICeulike_initJoinLoop(u1_t nDefaultChannels, s1_t adrTxPow);
 void LMICeulike_updateTx(ostime_t txbeg);
 #define LMICbandplan_updateTx(t)        LMICeulike_updateTx(t)
 
+u4_t LMICeulike_channelFreq(u1_t chnl);
+#define LMICbandplan_channelFreq(chnl)  LMICeulike_channelFreq(chnl)
+
 ostime_t LMICeulike_nextJoinState(uint8_t nDefaultChannels);
 
 static inline ostime_t LMICeulike_nextJoinTime(ostime_t now) {
@@ -111,5 +114,24 @@ void LMICeulike_setRx1Freq(void);
 bit_t LMICeulike_isDataRateFeasible(dr_t dr);
 #define LMICbandplan_isDataRateFeasible(dr) LMICeulike_isDataRateFeasible(dr)
 
+// call after changing channelMap, channelFreq or channelDrMap of the channels in changed.
+void LMICeulike_updateChannelMasks(u2_t changed);
+enum { LMICeulike_ALL_CHANNELS = (1 << MAX_CHANNELS) - 1 };
+
+// return the first channel set in mask after lastchnl, wrapping around.
+// mask must not be zero.
+static inline u1_t LMICeulike_nextChannel(u2_t mask, u1_t lastchnl) {
+        u1_t const start = (lastchnl + 1) % MAX_CHANNELS;
+        u2_t const rotated = (u2_t)((mask >> start) | (mask << (MAX_CHANNELS - start)));
+#if defined(__GNUC__)
+        u1_t const offset = __builtin_ctz(rotated);
+#else
+        u1_t offset = 0;
+        while ((rotated & (1 << offset)) == 0)
+                ++offset;
+#endif
+        return (start + offset) % MAX_CHANNELS;
+}
+
 
 #endif // _lmic_eu_like_h_
@@ -116,11 +116,12 @@ void LMICin866_initDefaultChannels(bit_t join) {
                 LMIC.channelFreq[fu] = TABLE_GET_U4(iniChannelFreq, fu);
                 LMIC.channelDrMap[fu] = DR_RANGE_MAP(IN866_DR_SF12, IN866_DR_SF7);
         }
+        LMICeulike_updateChannelMasks(LMICeulike_ALL_CHANNELS);
 
         LMIC.bands[BAND_MILLI].txcap = 1;  // no limit, in effect.
         LMIC.bands[BAND_MILLI].txpow = IN866_TX_EIRP_MAX_DBM;
         LMIC.bands[BAND_MILLI].lastchnl = os_getRndU1() % MAX_CHANNELS;
-        LMIC.bands[BAND_MILLI].avail = os_getTime();
+        LMIC.bands[BAND_MILLI].avail = os_getTime64();
 }
 
 bit_t LMIC_setupBand(u1_t bandidx, s1_t txpow, u2_t txcap) {
@@ -129,7 +130,7 @@ bit_t LMIC_setupBand(u1_t bandidx, s1_t txpow, u2_t txcap) {
         xref2band_t b = &LMIC.bands[bandidx];
         b->txpow = txpow;
         b->txcap = txcap;
-        b->avail = os_getTime();
+        b->avail = os_getTime64();
         b->lastchnl = os_getRndU1() % MAX_CHANNELS;
         return 1;
 }
@@ -161,6 +162,7 @@ bit_t LMIC_setupChannel(u1_t chidx, u4_t freq, u2_t drmap, s1_t band) {
                 LMIC.channelMap |= 1 << chidx;  // enabled right away
         else
                 LMIC.channelMap &= ~(1 << chidx);
+        LMICeulike_updateChannelMasks(1 << chidx);
         return 1;
 }
 
@@ -178,23 +180,11 @@ u4_t LMICin866_convFreq(xref2cu1_t ptr) {
 // we simply loop through the channels sequentially.
 ostime_t LMICin866_nextTx(ostime_t now) {
         const u1_t band = BAND_MILLI;
+        u2_t const mask = LMIC.channelBandDrMap[band][LMIC.datarate & 0xF];
 
-        for (u1_t ci = 0; ci < MAX_CHANNELS; ci++) {
-                // Find next channel in given band
-                u1_t chnl = LMIC.bands[band].lastchnl;
-                for (u1_t ci = 0; ci<MAX_CHANNELS; ci++) {
-                        if ((chnl = (chnl + 1)) >= MAX_CHANNELS)
-                                chnl -= MAX_CHANNELS;
-                        if ((LMIC.channelMap & (1 << chnl)) != 0 &&  // channel enabled
-                                (LMIC.channelDrMap[chnl] & (1 << (LMIC.datarate & 0xF))) != 0 &&
-                                band == (LMIC.channelFreq[chnl] & 0x3)) { // in selected band
-                                LMIC.txChnl = LMIC.bands[band].lastchnl = chnl;
-                                return now;
-                        }
-                }
-        }
-
-        // no enabled channel found! just use the last channel.
+        // if no enabled channel is found, just use the last channel.
+        if (mask != 0)
+                LMIC.txChnl = LMIC.bands[band].lastchnl = LMICeulike_nextChannel(mask, LMIC.bands[band].lastchnl);
         return now;
 }
 
@@ -186,6 +186,14 @@ bit_t  LMIC_selectSubBand(u1_t band) {
         return result;
 }
 
+u4_t LMICus915_channelFreq(u1_t chnl) {
+        if (chnl >= 64 + 8 || !ENABLED_CHANNEL(chnl))
+                return 0;
+        if (chnl < 64)
+                return US915_125kHz_UPFBASE + chnl*US915_125kHz_UPFSTEP;
+        return US915_500kHz_UPFBASE + (chnl - 64)*US915_500kHz_UPFSTEP;
+}
+
 void LMICus915_updateTx(ostime_t txbeg) {
         u1_t chnl = LMIC.txChnl;
         if (chnl < 64) {
@@ -209,7 +217,7 @@ void LMICus915_updateTx(ostime_t txbeg) {
         // Update global duty cycle stats
         if (LMIC.globalDutyRate != 0) {
                 ostime_t airtime = calcAirTime(LMIC.rps, LMIC.dataLen);
-                LMIC.globalDutyAvail = txbeg + (airtime << LMIC.globalDutyRate);
+                LMIC.globalDutyAvail = os_extendTime(txbeg) + (airtime << LMIC.globalDutyRate);
         }
 }
 
@@ -57,6 +57,29 @@ static void setNextChannel(uint start, uint end, uint count) {
                 }
         }
 
+#if LMIC_ENABLE_channel_stats
+        if (LMIC.client.adaptiveChannels) {
+                // Same candidates, but weighted by their delivery statistics.
+                u4_t total = 0;
+                for (u1_t chnl = start; chnl<end; chnl++) {
+                        if (chnl != lastTxChan && ENABLED_CHANNEL(chnl))
+                                total += LMICcore_channelWeight(chnl);
+                }
+                u4_t pick = os_getRndU2() % total;
+                for (u1_t chnl = start; chnl<end; chnl++) {
+                        if (chnl != lastTxChan && ENABLED_CHANNEL(chnl)) {
+                                u2_t const weight = LMICcore_channelWeight(chnl);
+                                if (pick < weight) {
+                                        LMIC.txChnl = chnl;
+                                        return;
+                                }
+                                pick -= weight;
+                        }
+                }
+                return;
+        }
+#endif // LMIC_ENABLE_channel_stats
+
         uint nth = os_getRndU1() % count;
         for (u1_t chnl = start; chnl<end; chnl++) {
                 // Scan for nth enabled channel that is not the last channel used
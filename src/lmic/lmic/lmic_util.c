@@ -333,3 +333,476 @@ LMIC_f2uflt12(
                 return (uint16_t)((iExp << 8u) | outputFraction);
                 }
         }
+
+/*
+
+Name:   LMIC_sflt162f(), LMIC_sflt122f(), LMIC_uflt162f(), LMIC_uflt122f()
+
+Function:
+        Decode a value produced by the matching LMIC_f2*() encoder.
+
+Definition:
+        float LMIC_sflt162f(
+                uint16_t v
+                );
+
+Description:
+        The inverse of LMIC_f2sflt16() and friends: the mantissa is scaled
+        by 2^(exponent - 15), and the sign (if any) is applied. Bits above
+        the encoded width are ignored.
+
+Returns:
+        The decoded value, in (-1.0, 1.0) for signed formats and [0, 1.0)
+        for unsigned formats.
+
+*/
+
+static float
+decodeFloat(
+        uint16_t v,
+        unsigned nFraction,
+        unsigned signBit
+        )
+        {
+        unsigned const fraction = v & ((1u << nFraction) - 1);
+        int const iExp = (v >> nFraction) & 0xF;
+        float const f = ldexpf((float)fraction, iExp - 15 - (int)nFraction);
+
+        return (signBit != 0 && (v & signBit) != 0) ? -f : f;
+        }
+
+float
+LMIC_sflt162f(
+        uint16_t v
+        )
+        {
+        return decodeFloat(v, 11, 0x8000);
+        }
+
+float
+LMIC_sflt122f(
+        uint16_t v
+        )
+        {
+        return decodeFloat(v, 7, 0x800);
+        }
+
+float
+LMIC_uflt162f(
+        uint16_t v
+        )
+        {
+        return decodeFloat(v, 12, 0);
+        }
+
+float
+LMIC_uflt122f(
+        uint16_t v
+        )
+        {
+        return decodeFloat(v, 8, 0);
+        }
+
+/*
+
+Name:   LMIC_encodeSflt16() and friends
+
+Function:
+        Encode an array of samples into a buffer.
+
+Definition:
+        size_t LMIC_encodeSflt16(
+                uint8_t *pOut,
+                size_t nOut,
+                const float *pIn,
+                size_t nIn
+                );
+
+Description:
+        Each sample is encoded with the matching scalar LMIC_f2*() function.
+        16-bit formats are written as big-endian pairs of bytes. 12-bit
+        formats are packed big-endian, two samples in three bytes; an odd
+        trailing sample uses two bytes with the low nibble zero.
+
+        pOut may be LMIC.pendTxData, followed by LMIC_setTxData(), to build
+        an uplink without an intermediate copy.
+
+        The LMIC_decode*() functions do the inverse, decoding at most nOut
+        samples.
+
+Returns:
+        Number of bytes written, or 0 if nOut is too small. The decoders
+        return the number of samples written.
+
+*/
+
+static size_t
+encode16(
+        uint8_t *pOut,
+        size_t nOut,
+        const float *pIn,
+        size_t nIn,
+        uint16_t (*pEncode)(float)
+        )
+        {
+        if (nOut < nIn * 2)
+                return 0;
+
+        for (size_t i = 0; i < nIn; ++i)
+                {
+                uint16_t const v = pEncode(pIn[i]);
+
+                pOut[2 * i + 0] = (uint8_t)(v >> 8);
+                pOut[2 * i + 1] = (uint8_t)v;
+                }
+
+        return nIn * 2;
+        }
+
+static size_t
+encode12(
+        uint8_t *pOut,
+        size_t nOut,
+        const float *pIn,
+        size_t nIn,
+        uint16_t (*pEncode)(float)
+        )
+        {
+        size_t const nBytes = (nIn * 12 + 7) / 8;
+
+        if (nOut < nBytes)
+                return 0;
+
+        for (size_t i = 0; i + 1 < nIn; i += 2)
+                {
+                uint16_t const v0 = pEncode(pIn[i]);
+                uint16_t const v1 = pEncode(pIn[i + 1]);
+                uint8_t * const p = pOut + i / 2 * 3;
+
+                p[0] = (uint8_t)(v0 >> 4);
+                p[1] = (uint8_t)((v0 << 4) | ((v1 >> 8) & 0xF));
+                p[2] = (uint8_t)v1;
+                }
+
+        if (nIn & 1)
+                {
+                uint16_t const v = pEncode(pIn[nIn - 1]);
+                uint8_t * const p = pOut + nIn / 2 * 3;
+
+                p[0] = (uint8_t)(v >> 4);
+                p[1] = (uint8_t)(v << 4);
+                }
+
+        return nBytes;
+        }
+
+static size_t
+decode16(
+        float *pOut,
+        size_t nOut,
+        const uint8_t *pIn,
+        size_t nIn,
+        float (*pDecode)(uint16_t)
+        )
+        {
+        size_t const n = nIn / 2 < nOut ? nIn / 2 : nOut;
+
+        for (size_t i = 0; i < n; ++i)
+                pOut[i] = pDecode((uint16_t)((pIn[2 * i] << 8) | pIn[2 * i + 1]));
+
+        return n;
+        }
+
+static size_t
+decode12(
+        float *pOut,
+        size_t nOut,
+        const uint8_t *pIn,
+        size_t nIn,
+        float (*pDecode)(uint16_t)
+        )
+        {
+        size_t const nSamples = nIn * 8 / 12;
+        size_t const n = nSamples < nOut ? nSamples : nOut;
+
+        for (size_t i = 0; i < n; ++i)
+                {
+                const uint8_t * const p = pIn + i / 2 * 3;
+                uint16_t v;
+
+                if ((i & 1) == 0)
+                        v = (uint16_t)((p[0] << 4) | (p[1] >> 4));
+                else
+                        v = (uint16_t)(((p[1] & 0xF) << 8) | p[2]);
+
+                pOut[i] = pDecode(v);
+                }
+
+        return n;
+        }
+
+size_t
+LMIC_encodeSflt16(
+        uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn
+        )
+        {
+        return encode16(pOut, nOut, pIn, nIn, LMIC_f2sflt16);
+        }
+
+size_t
+LMIC_encodeUflt16(
+        uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn
+        )
+        {
+        return encode16(pOut, nOut, pIn, nIn, LMIC_f2uflt16);
+        }
+
+size_t
+LMIC_encodeSflt12(
+        uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn
+        )
+        {
+        return encode12(pOut, nOut, pIn, nIn, LMIC_f2sflt12);
+        }
+
+size_t
+LMIC_encodeUflt12(
+        uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn
+        )
+        {
+        return encode12(pOut, nOut, pIn, nIn, LMIC_f2uflt12);
+        }
+
+size_t
+LMIC_decodeSflt16(
+        float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn
+        )
+        {
+        return decode16(pOut, nOut, pIn, nIn, LMIC_sflt162f);
+        }
+
+size_t
+LMIC_decodeUflt16(
+        float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn
+        )
+        {
+        return decode16(pOut, nOut, pIn, nIn, LMIC_uflt162f);
+        }
+
+size_t
+LMIC_decodeSflt12(
+        float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn
+        )
+        {
+        return decode12(pOut, nOut, pIn, nIn, LMIC_sflt122f);
+        }
+
+size_t
+LMIC_decodeUflt12(
+        float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn
+        )
+        {
+        return decode12(pOut, nOut, pIn, nIn, LMIC_uflt122f);
+        }
+
+/*
+
+Name:   LMIC_encodeFixed16()
+
+Function:
+        Encode an array of samples as scaled 16-bit integers.
+
+Definition:
+        size_t LMIC_encodeFixed16(
+                uint8_t *pOut,
+                size_t nOut,
+                const float *pIn,
+                size_t nIn,
+                float scale
+                );
+
+Description:
+        Each sample is multiplied by scale, rounded to the nearest integer
+        and saturated to [-32768, 32767], then written as a big-endian
+        two's complement 16-bit value. For example, a scale of 100 sends
+        temperatures in hundredths of a degree.
+
+        This is the fast path: unlike the floating formats it needs no
+        frexpf() per sample, and rounding and saturation are done with
+        fminf()/fmaxf()/floorf() rather than branches, so the loop body
+        is straight-line code.
+
+        LMIC_decodeFixed16() divides by scale to recover the samples.
+
+Returns:
+        Number of bytes written, or 0 if nOut is too small.
+
+*/
+
+static int32_t
+toFixed(
+        float f,
+        float scale,
+        float lo,
+        float hi
+        )
+        {
+        float const v = fmaxf(lo, fminf(hi, floorf(f * scale + 0.5f)));
+
+        return (int32_t)v;
+        }
+
+size_t
+LMIC_encodeFixed16(
+        uint8_t *pOut,
+        size_t nOut,
+        const float *pIn,
+        size_t nIn,
+        float scale
+        )
+        {
+        if (nOut < nIn * 2)
+                return 0;
+
+        for (size_t i = 0; i < nIn; ++i)
+                {
+                uint16_t const v = (uint16_t)toFixed(pIn[i], scale, -32768.0f, 32767.0f);
+
+                pOut[2 * i + 0] = (uint8_t)(v >> 8);
+                pOut[2 * i + 1] = (uint8_t)v;
+                }
+
+        return nIn * 2;
+        }
+
+size_t
+LMIC_decodeFixed16(
+        float *pOut,
+        size_t nOut,
+        const uint8_t *pIn,
+        size_t nIn,
+        float scale
+        )
+        {
+        size_t const n = nIn / 2 < nOut ? nIn / 2 : nOut;
+
+        for (size_t i = 0; i < n; ++i)
+                pOut[i] = (int16_t)((pIn[2 * i] << 8) | pIn[2 * i + 1]) / scale;
+
+        return n;
+        }
+
+/*
+
+Name:   LMIC_encodeDeltaVarint()
+
+Function:
+        Encode an array of slowly-changing samples compactly.
+
+Definition:
+        size_t LMIC_encodeDeltaVarint(
+                uint8_t *pOut,
+                size_t nOut,
+                const float *pIn,
+                size_t nIn,
+                float scale
+                );
+
+Description:
+        Samples are scaled and rounded as in LMIC_encodeFixed16() (but
+        saturated to 24 bits). The first value and then the difference of
+        each value to the previous one are zig-zag encoded (so small
+        negative numbers stay small) and written as little-endian base-128
+        varints: 7 bits per byte, with bit 7 set if another byte follows.
+        A series that changes by less than +/-64 steps per sample takes one
+        byte per sample.
+
+        LMIC_decodeDeltaVarint() reverses the process, and stops at the
+        first truncated varint.
+
+Returns:
+        Number of bytes written, or 0 if nOut is too small.
+
+*/
+
+static size_t
+putVarint(
+        uint8_t *pOut,
+        size_t nOut,
+        uint32_t v
+        )
+        {
+        size_t n = 0;
+
+        do      {
+                if (n == nOut)
+                        return 0;
+                pOut[n++] = (uint8_t)((v & 0x7F) | (v > 0x7F ? 0x80 : 0));
+                v >>= 7;
+                } while (v != 0);
+
+        return n;
+        }
+
+size_t
+LMIC_encodeDeltaVarint(
+        uint8_t *pOut,
+        size_t nOut,
+        const float *pIn,
+        size_t nIn,
+        float scale
+        )
+        {
+        size_t iOut = 0;
+        int32_t previous = 0;
+
+        for (size_t i = 0; i < nIn; ++i)
+                {
+                int32_t const v = toFixed(pIn[i], scale, -8388608.0f, 8388607.0f);
+                int32_t const delta = v - previous;
+                uint32_t const zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+                size_t const n = putVarint(pOut + iOut, nOut - iOut, zigzag);
+
+                if (n == 0)
+                        return 0;
+
+                iOut += n;
+                previous = v;
+                }
+
+        return iOut;
+        }
+
+size_t
+LMIC_decodeDeltaVarint(
+        float *pOut,
+        size_t nOut,
+        const uint8_t *pIn,
+        size_t nIn,
+        float scale
+        )
+        {
+        size_t iIn = 0;
+        size_t n = 0;
+        int32_t previous = 0;
+
+        while (n < nOut && iIn < nIn)
+                {
+                uint32_t zigzag = 0;
+                unsigned shift = 0;
+                uint8_t b;
+
+                do      {
+                        if (iIn == nIn || shift > 28)
+                                return n;
+                        b = pIn[iIn++];
+                        zigzag |= (uint32_t)(b & 0x7F) << shift;
+                        shift += 7;
+                        } while (b & 0x80);
+
+                previous += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+                pOut[n++] = previous / scale;
+                }
+
+        return n;
+        }
@@ -21,12 +21,34 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 
 uint16_t LMIC_f2sflt16(float);
 uint16_t LMIC_f2sflt12(float);
 uint16_t LMIC_f2uflt16(float);
 uint16_t LMIC_f2uflt12(float);
 
+float LMIC_sflt162f(uint16_t);
+float LMIC_sflt122f(uint16_t);
+float LMIC_uflt162f(uint16_t);
+float LMIC_uflt122f(uint16_t);
+
+// batch encoders return the number of bytes written to pOut, or 0 if
+// nOut is too small. Batch decoders return the number of samples written.
+size_t LMIC_encodeSflt16(uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn);
+size_t LMIC_encodeUflt16(uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn);
+size_t LMIC_encodeSflt12(uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn);
+size_t LMIC_encodeUflt12(uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn);
+size_t LMIC_decodeSflt16(float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn);
+size_t LMIC_decodeUflt16(float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn);
+size_t LMIC_decodeSflt12(float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn);
+size_t LMIC_decodeUflt12(float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn);
+
+size_t LMIC_encodeFixed16(uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn, float scale);
+size_t LMIC_decodeFixed16(float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn, float scale);
+size_t LMIC_encodeDeltaVarint(uint8_t *pOut, size_t nOut, const float *pIn, size_t nIn, float scale);
+size_t LMIC_decodeDeltaVarint(float *pOut, size_t nOut, const uint8_t *pIn, size_t nIn, float scale);
+
 #ifdef __cplusplus
 }
 #endif
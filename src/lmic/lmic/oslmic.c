@@ -57,6 +57,17 @@ ostime_t os_getTime () {
     return hal_ticks();
 }
 
+ostime64_t os_getTime64 () {
+    return (ostime64_t) hal_ticks64();
+}
+
+// return the 64-bit time of a 32-bit time that is less than 2^31 ticks
+// (about 9.5 hours) before or after now.
+ostime64_t os_extendTime (ostime_t time) {
+    ostime64_t const now = os_getTime64();
+    return now + (s4_t) (time - (ostime_t) now);
+}
+
 // unlink job from queue, return if removed
 static int unlinkjob (osjob_t** pnext, osjob_t* job) {
     for( ; *pnext; pnext = &((*pnext)->next)) {
@@ -139,6 +150,8 @@ void os_runloop () {
 
 void os_runloop_once() {
     osjob_t* j = NULL;
+    // service the radio first, its handler schedules the job to run
+    hal_processPendingIRQs();
     hal_disableIRQs();
     // check for runnable jobs
     if(OS.runnablejobs) {
@@ -165,3 +178,21 @@ bit_t os_queryTimeCriticalJobs(ostime_t time) {
     else
         return 0;
 }
+
+// return true if any job is pending, and set *pDeadline to the time the
+// first one is due (now, if a job is runnable). Return false if the
+// scheduler is idle.
+bit_t os_queryNextDeadline(ostime_t *pDeadline) {
+    bit_t result = 1;
+
+    hal_disableIRQs();
+    if (OS.runnablejobs)
+        *pDeadline = os_getTime();
+    else if (OS.scheduledjobs)
+        *pDeadline = OS.scheduledjobs->deadline;
+    else
+        result = 0;
+    hal_enableIRQs();
+
+    return result;
+}
@@ -104,7 +104,7 @@ struct oslmic_radio_rssi_s {
         s2_t    min_rssi;
         s2_t    max_rssi;
         s2_t    mean_rssi;
-        u2_t    n_rssi;
+        u4_t    n_rssi;
 };
 
 int radio_init (void);
@@ -203,6 +203,12 @@ ostime_t os_getRadioRxRampup (void);
 #ifndef os_getTime
 ostime_t os_getTime (void);
 #endif
+#ifndef os_getTime64
+ostime64_t os_getTime64 (void);
+#endif
+#ifndef os_extendTime
+ostime64_t os_extendTime (ostime_t time);
+#endif
 #ifndef os_getTimeSecs
 uint os_getTimeSecs (void);
 #endif
@@ -216,6 +222,10 @@ u1_t os_getBattLevel (void);
 //! Return non-zero if any jobs are scheduled between now and now+time.
 bit_t os_queryTimeCriticalJobs(ostime_t time);
 #endif
+#ifndef os_queryNextDeadline
+//! Return non-zero if any job is pending, and set *pDeadline to when the first one is due.
+bit_t os_queryNextDeadline(ostime_t *pDeadline);
+#endif
 
 #ifndef os_rlsbf4
 //! Read 32-bit quantity from given pointer in little endian byte order.
@@ -38,6 +38,8 @@ typedef const char*        str_t;
 
 // the HAL needs to give us ticks, so it ought to know the right type.
 typedef              s4_t  ostime_t;
+// the same clock in 64 bits, which doesn't wrap in practice.
+typedef           int64_t  ostime64_t;
 
 #ifdef __cplusplus
 }
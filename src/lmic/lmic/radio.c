@@ -340,6 +340,7 @@
 // DIO function mappings                D0D1D2D3
 #define MAP_DIO0_LORA_RXDONE   0x00  // 00------
 #define MAP_DIO0_LORA_TXDONE   0x40  // 01------
+#define MAP_DIO0_LORA_CADDONE  0x80  // 10------
 #define MAP_DIO1_LORA_RXTOUT   0x00  // --00----
 #define MAP_DIO1_LORA_NOP      0x30  // --11----
 #define MAP_DIO2_LORA_NOP      0x0C  // ----11--
@@ -856,6 +857,77 @@ static void txlora () {
 #endif
 }
 
+// count a failed listen-before-talk check against the uplink's channel
+static void lbtbusy () {
+#if LMIC_ENABLE_channel_stats
+    if (LMIC.txChnl < LMIC_CHANNEL_STATS_COUNT &&
+        LMIC.channelStats[LMIC.txChnl].busy < LMIC.channelStats[LMIC.txChnl].uplinks)
+        LMIC.channelStats[LMIC.txChnl].busy += 1;
+#endif
+}
+
+#if LMIC_ENABLE_lbt_cad
+// start listen before talk with channel activity detection on the uplink's
+// channel and spreading factor. A CAD cycle takes about two symbols and ends
+// with CadDone on DIO0; cadcomplete() repeats it from the IRQ handler until
+// the LBT window is covered, so nothing polls the radio meanwhile.
+static void startcad () {
+    // select LoRa modem (from sleep mode)
+    opmodeLora();
+    ASSERT((readReg(RegOpMode) & OPMODE_LORA) != 0);
+    // enter standby mode (warm up)
+    opmode(OPMODE_STANDBY);
+    // configure LoRa modem (cfg1, cfg2) and frequency like for the uplink
+    configLoraModem();
+    configChannel();
+    // set LNA gain
+    writeReg(RegLna, LNA_RX_GAIN);
+    // look for other devices' uplinks, which aren't inverted
+    writeReg(LORARegInvertIQ, readReg(LORARegInvertIQ) & ~(1<<6));
+
+    // configure DIO mapping DIO0=CadDone DIO1=NOP DIO2=NOP
+    writeReg(RegDioMapping1, MAP_DIO0_LORA_CADDONE|MAP_DIO1_LORA_NOP|MAP_DIO2_LORA_NOP);
+    // clear all radio IRQ flags
+    writeReg(LORARegIrqFlags, 0xFF);
+    // enable CadDone and CadDetected; masked ones wouldn't show in the flags
+    writeReg(LORARegIrqFlagsMask, (u1_t) ~(IRQ_LORA_CDDONE_MASK|IRQ_LORA_CDDETD_MASK));
+
+    // enable antenna switch for RX
+    hal_pin_rxtx(0);
+
+    // 0 means no CAD is running, so the end moves by a tick in that case
+    LMIC.radio.cad_end = os_getTime() + LMIC.lbt_ticks;
+    if (LMIC.radio.cad_end == 0)
+        LMIC.radio.cad_end = 1;
+    ++LMIC.radio.cad_count;
+    LMICOS_logEventUint32("+CAD LoRa", LMIC.lbt_ticks);
+    opmode(OPMODE_CAD);
+}
+
+// handle the end of a CAD cycle. Returns 1 if the radio was started again,
+// with another cycle or the uplink; 0 if activity was detected, in which case
+// the IRQ handler completes the request like a busy RSSI check does.
+static bit_t cadcomplete (u1_t flags, ostime_t now) {
+    if (flags & IRQ_LORA_CDDETD_MASK) {
+        LMIC.radio.cad_end = 0;
+        LMIC_X_DEBUG_PRINTF("LBT CAD busy after %u cycles\n", LMIC.radio.cad_count);
+        lbtbusy();
+        return 0;
+    }
+    // the radio is back in standby after each cycle
+    writeReg(LORARegIrqFlags, 0xFF);
+    if (now - LMIC.radio.cad_end < 0) {
+        ++LMIC.radio.cad_count;
+        opmode(OPMODE_CAD);
+        return 1;
+    }
+    LMIC.radio.cad_end = 0;
+    opmode(OPMODE_SLEEP);
+    txlora();
+    return 1;
+}
+#endif // LMIC_ENABLE_lbt_cad
+
 // start transmitter (buf=LMIC.frame, len=LMIC.dataLen)
 static void starttx () {
     u1_t const rOpMode = readReg(RegOpMode);
@@ -871,14 +943,22 @@ static void starttx () {
         hal_waitUntil(os_getTime() + ms2osticks(1));
     }
 
+#if LMIC_ENABLE_lbt_cad
+    if (LMIC.lbt_ticks > 0 && LMIC.client.lbtCad && getSf(LMIC.rps) != FSK) {
+        // the IRQ handler transmits once the channel is found clear
+        startcad();
+        return;
+    }
+#endif
     if (LMIC.lbt_ticks > 0) {
         oslmic_radio_rssi_t rssi;
         radio_monitor_rssi(LMIC.lbt_ticks, &rssi);
 #if LMIC_X_DEBUG_LEVEL > 0
-        LMIC_X_DEBUG_PRINTF("LBT rssi max:min=%d:%d %d times in %d\n", rssi.max_rssi, rssi.min_rssi, rssi.n_rssi, LMIC.lbt_ticks);
+        LMIC_X_DEBUG_PRINTF("LBT rssi max:min=%d:%d %d times in %d\n", rssi.max_rssi, rssi.min_rssi, (int) rssi.n_rssi, LMIC.lbt_ticks);
 #endif
 
         if (rssi.max_rssi >= LMIC.lbt_dbmax) {
+            lbtbusy();
             // complete the request by scheduling the job
             os_setCallback(&LMIC.osjob, LMIC.osjob.func);
             return;
@@ -1171,8 +1251,9 @@ s2_t radio_rssi () {
 // current radio setting per section 5.5.5 of Semtech 1276 datasheet.
 void radio_monitor_rssi(ostime_t nTicks, oslmic_radio_rssi_t *pRssi) {
     uint8_t rssiMax, rssiMin;
-    uint16_t rssiSum;
-    uint16_t rssiN;
+    // a sample takes a few microseconds, so long scans need 32 bits
+    uint32_t rssiSum;
+    uint32_t rssiN;
 
     int rssiAdjust;
     ostime_t tBegin;
@@ -1194,8 +1275,8 @@ void radio_monitor_rssi(ostime_t nTicks, oslmic_radio_rssi_t *pRssi) {
     rssiAdjust += hal_getRssiCal();
 
     // zero the results
-    rssiMax = 255;
-    rssiMin = 0;
+    rssiMax = 0;
+    rssiMin = 255;
     rssiSum = 0;
     rssiN = 0;
 
@@ -1204,7 +1285,6 @@ void radio_monitor_rssi(ostime_t nTicks, oslmic_radio_rssi_t *pRssi) {
 
     // scan for the desired time.
     tBegin = os_getTime();
-    rssiMax = 0;
 
     /* XXX(tanupoo)
      * In this loop, micros() in os_getTime() returns a past time sometimes.
@@ -1238,7 +1318,7 @@ void radio_monitor_rssi(ostime_t nTicks, oslmic_radio_rssi_t *pRssi) {
     // compute the results
     pRssi->max_rssi = (s2_t) (rssiMax + rssiAdjust);
     pRssi->min_rssi = (s2_t) (rssiMin + rssiAdjust);
-    pRssi->mean_rssi = (s2_t) (rssiAdjust + ((rssiSum + (rssiN >> 1)) / rssiN));
+    pRssi->mean_rssi = (s2_t) (rssiAdjust + (int) ((rssiSum + (rssiN >> 1)) / rssiN));
     pRssi->n_rssi = rssiN;
 }
 
@@ -1279,11 +1359,22 @@ void radio_irq_handler_v2 (u1_t dio, ostime_t now) {
 #if LMIC_DEBUG_LEVEL > 0
     ostime_t const entry = now;
 #endif
+    // now is when the HAL saw the edge
+    ostime_t const latency = os_getTime() - now;
+    LMIC.radio.irq_latency_ticks += latency;
+    if (latency > LMIC.radio.irq_latency_max)
+        LMIC.radio.irq_latency_max = latency;
+    ++LMIC.radio.irq_count;
+
     if( (readReg(RegOpMode) & OPMODE_LORA) != 0) { // LORA modem
         u1_t flags = readReg(LORARegIrqFlags);
         LMIC.saveIrqFlags = flags;
         LMICOS_logEventUint32("radio_irq_handler_v2: LoRa", flags);
         LMIC_X_DEBUG_PRINTF("IRQ=%02x\n", flags);
+#if LMIC_ENABLE_lbt_cad
+        if (LMIC.radio.cad_end != 0 && cadcomplete(flags, now))
+            return;
+#endif
         if( flags & IRQ_LORA_TXDONE_MASK ) {
             // save exact tx time
             LMIC.txend = now - us2osticks(43); // TXDONE FIXUP
@@ -1377,6 +1468,10 @@ void os_radio (u1_t mode) {
       case RADIO_RST:
         // put radio to sleep
         opmode(OPMODE_SLEEP);
+#if LMIC_ENABLE_lbt_cad
+        // abandon listen before talk in progress
+        LMIC.radio.cad_end = 0;
+#endif
         break;
 
       case RADIO_TX: